@@ -0,0 +1,46 @@
+#pragma once
+
+#include <Core/Core.hpp>
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+struct BatchOptions
+{
+  std::vector<OpConfig> chain;
+  ExecutionMode mode = ExecutionMode::Staged;
+
+  // Number of images processed concurrently.
+  size_t n_workers = 1;
+
+  // Directory the results are written to as PGM files named after the inputs (a.ppm 
+  // gives a.ppm.pgm, a.pgm stays a.pgm), nothing is written if empty.
+  std::string output_dir;
+};
+
+struct BatchStats
+{
+  size_t processed = 0;
+  size_t failed = 0;
+  size_t pixels = 0;
+
+  // Workers actually run, at most one per file.
+  size_t workers = 0;
+
+  // Wall time of the whole batch.
+  double seconds = 0.0;
+
+  // Time spent in each step, summed over the workers.
+  double read_seconds = 0.0;
+  double process_seconds = 0.0;
+  double write_seconds = 0.0;
+};
+
+// Applies the chain to every file (see read_pnm) with a pool of workers. Every worker
+// has its own chain and keeps its input and output images, so that same-sized files
+// do not allocate. Files that fail are reported to the log and counted. Throws
+// std::runtime_error before processing if two files would get the same output name.
+BatchStats process_batch(std::vector<std::string> const& files, BatchOptions const& options, std::ostream& log);
+
+void print_batch_stats(BatchStats const& stats, std::ostream& stream);
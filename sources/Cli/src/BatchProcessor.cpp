@@ -0,0 +1,139 @@
+#include <Cli/BatchProcessor.hpp>
+
+#include <Core/ImageIO.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <filesystem>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+namespace detail
+{
+  using Clock = std::chrono::steady_clock;
+
+  double seconds_since(Clock::time_point start)
+  {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+  }
+
+  // The input file name with ".pgm" appended unless it is a PGM already, so that e.g.
+  // a.pgm and a.ppm do not collide.
+  std::string output_file_name(std::string const& output_dir, std::string const& input_file)
+  {
+    auto name = std::filesystem::path(input_file).filename();
+    if (name.extension() != ".pgm")
+      name += ".pgm";
+
+    return (std::filesystem::path(output_dir) / name).string();
+  }
+
+  // Same-named files from different directories would overwrite each other's results.
+  void check_output_file_names(std::string const& output_dir, std::vector<std::string> const& files)
+  {
+    std::map<std::string, std::string const*> inputs;
+    for (auto const& file : files)
+    {
+      const auto [it, inserted] = inputs.emplace(output_file_name(output_dir, file), &file);
+      if (!inserted)
+        throw std::runtime_error("'" + *it->second + "' and '" + file + "' would both be written to '" + it->first + "'");
+    }
+  }
+}
+
+BatchStats process_batch(std::vector<std::string> const& files, BatchOptions const& options, std::ostream& log)
+{
+  if (!options.output_dir.empty())
+    detail::check_output_file_names(options.output_dir, files);
+
+  const auto start = detail::Clock::now();
+
+  BatchStats stats;
+  std::mutex stats_mutex;
+  std::atomic<size_t> next_file{ 0 };
+
+  const auto worker = [&]()
+  {
+    OperationChain chain;
+    chain.setExecutionMode(options.mode);
+    for (size_t i = 0; i < options.chain.size(); ++i)
+      chain.addOperation(int(i), options.chain[i]);
+
+    // Reused for all the files of the worker.
+    Image2d<float> in;
+    AnyImage out;
+
+    BatchStats worker_stats;
+    for (auto i = next_file++; i < files.size(); i = next_file++)
+    {
+      auto const& file = files[i];
+      try
+      {
+        auto step_start = detail::Clock::now();
+        read_pnm(file, in);
+        worker_stats.read_seconds += detail::seconds_since(step_start);
+
+        step_start = detail::Clock::now();
+        chain.executeChain(in.view(), out);
+        worker_stats.process_seconds += detail::seconds_since(step_start);
+
+        if (!options.output_dir.empty())
+        {
+          step_start = detail::Clock::now();
+          write_pgm(detail::output_file_name(options.output_dir, file), any_view(std::as_const(out)));
+          worker_stats.write_seconds += detail::seconds_since(step_start);
+        }
+
+        ++worker_stats.processed;
+        worker_stats.pixels += size_t(in.height() * in.width());
+      }
+      catch (std::exception const& error)
+      {
+        ++worker_stats.failed;
+
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        log << "Failed to process '" << file << "': " << error.what() << '\n';
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    stats.processed += worker_stats.processed;
+    stats.failed += worker_stats.failed;
+    stats.pixels += worker_stats.pixels;
+    stats.read_seconds += worker_stats.read_seconds;
+    stats.process_seconds += worker_stats.process_seconds;
+    stats.write_seconds += worker_stats.write_seconds;
+  };
+
+  const auto n_workers = std::max<size_t>(1, std::min(options.n_workers, files.size()));
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < n_workers; ++i)
+    workers.emplace_back(worker);
+
+  worker();
+  for (auto& thread : workers)
+    thread.join();
+
+  stats.workers = n_workers;
+  stats.seconds = detail::seconds_since(start);
+  return stats;
+}
+
+void print_batch_stats(BatchStats const& stats, std::ostream& stream)
+{
+  const auto seconds = std::max(stats.seconds, 1e-9);
+  const auto megapixels = 1e-6 * double(stats.pixels);
+
+  stream << std::fixed << std::setprecision(2);
+  stream << "Processed " << stats.processed << " images (" << stats.failed << " failed), " <<
+    megapixels << " MPix in " << stats.seconds << " s\n";
+  stream << "  " << double(stats.processed) / seconds << " images/s, " << megapixels / seconds << " MPix/s\n";
+  stream << "  read " << stats.read_seconds << " s, process " << stats.process_seconds << " s, write " <<
+    stats.write_seconds << " s (summed over " << stats.workers << " workers)\n";
+}
@@ -0,0 +1,147 @@
+#include <Cli/BatchProcessor.hpp>
+
+#include <Core/Serialization.hpp>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace detail
+{
+  const char usage[] =
+    "Usage: Cli --chain FILE [--workers N] [--mode staged|fused] [--output DIR] [--list FILE] [PATH...]\n"
+    "\n"
+    "Applies the operation chain described in FILE (see Core/Serialization.hpp) to every\n"
+    "PGM/PPM image. A PATH is an image or a directory whose images are all processed,\n"
+    "--list names a file listing one image per line. The results are written to DIR as\n"
+    "PGM files if given. N defaults to the number of hardware threads.\n";
+
+  bool is_image_file(std::filesystem::path const& path)
+  {
+    const auto extension = path.extension().string();
+    return extension == ".pgm" || extension == ".ppm" || extension == ".pnm";
+  }
+
+  void add_input_path(std::string const& path, std::vector<std::string>& files)
+  {
+    if (!std::filesystem::is_directory(path))
+    {
+      files.push_back(path);
+      return;
+    }
+
+    std::vector<std::string> dir_files;
+    for (auto const& entry : std::filesystem::directory_iterator(path))
+    {
+      if (entry.is_regular_file() && is_image_file(entry.path()))
+        dir_files.push_back(entry.path().string());
+    }
+
+    std::sort(dir_files.begin(), dir_files.end());
+    files.insert(files.end(), dir_files.begin(), dir_files.end());
+  }
+
+  void add_list_file(std::string const& list_file, std::vector<std::string>& files)
+  {
+    std::ifstream list(list_file);
+    if (!list)
+      throw std::runtime_error("cannot open file list '" + list_file + "'");
+
+    std::string line;
+    while (std::getline(list, line))
+    {
+      if (!line.empty() && line.back() == '\r')
+        line.pop_back();
+
+      if (!line.empty())
+        files.push_back(line);
+    }
+  }
+}
+
+int main(int argc, char** argv)
+{
+  try
+  {
+    std::string chain_file;
+    std::vector<std::string> files;
+    BatchOptions options;
+    options.n_workers = max_threads();
+
+    for (int i = 1; i < argc; ++i)
+    {
+      const std::string arg = argv[i];
+      const auto value = [&]() -> std::string
+      {
+        if (i + 1 >= argc)
+          throw std::runtime_error("missing value of " + arg);
+
+        return argv[++i];
+      };
+
+      if (arg == "--chain")
+      {
+        chain_file = value();
+      }
+      else if (arg == "--workers")
+      {
+        options.n_workers = size_t(std::max(1, std::stoi(value())));
+      }
+      else if (arg == "--mode")
+      {
+        const auto mode = value();
+        if (mode != "staged" && mode != "fused")
+          throw std::runtime_error("unknown mode '" + mode + "'");
+
+        options.mode = mode == "fused" ? ExecutionMode::Fused : ExecutionMode::Staged;
+      }
+      else if (arg == "--output")
+      {
+        options.output_dir = value();
+      }
+      else if (arg == "--list")
+      {
+        detail::add_list_file(value(), files);
+      }
+      else if (arg == "--help" || arg == "-h")
+      {
+        std::cout << detail::usage;
+        return 0;
+      }
+      else if (!arg.empty() && arg[0] == '-')
+      {
+        throw std::runtime_error("unknown option " + arg);
+      }
+      else
+      {
+        detail::add_input_path(arg, files);
+      }
+    }
+
+    if (chain_file.empty())
+      throw std::runtime_error("no chain description given");
+
+    options.chain = read_chain(chain_file);
+
+    if (!options.output_dir.empty())
+      std::filesystem::create_directories(options.output_dir);
+
+    // The workers process separate images, so every image runs on a single thread.
+    if (options.n_workers > 1)
+      set_max_threads(1);
+
+    const auto stats = process_batch(files, options, std::cerr);
+    print_batch_stats(stats, std::cout);
+
+    return stats.failed == 0 ? 0 : 1;
+  }
+  catch (std::exception const& error)
+  {
+    std::cerr << "Error: " << error.what() << "\n\n" << detail::usage;
+    return 2;
+  }
+}
@@ -0,0 +1,301 @@
+#include <benchmark/benchmark.h>
+
+#include <Core/Core.hpp>
+
+#include <random>
+
+namespace
+{
+  // Square images from 256^2 up to 4096^2, then 4K and 8K UHD frames.
+  void image_sizes(benchmark::internal::Benchmark* bench)
+  {
+    bench->ArgNames({ "h", "w" });
+    for (const auto side : { 256, 512, 1024, 2048, 4096 })
+      bench->Args({ side, side });
+
+    bench->Args({ 2160, 3840 });
+    bench->Args({ 4320, 7680 });
+  }
+
+  void image_sizes_and_border_conditions(benchmark::internal::Benchmark* bench)
+  {
+    bench->ArgNames({ "h", "w", "bc" });
+    for (const auto bc : { BorderCondition::BC_ZERO, BorderCondition::BC_CLAMP, BorderCondition::BC_WRAP })
+    {
+      for (const auto side : { 256, 1024, 4096 })
+        bench->Args({ side, side, int(bc) });
+
+      bench->Args({ 4320, 7680, int(bc) });
+    }
+  }
+
+  void image_sizes_and_radii(benchmark::internal::Benchmark* bench)
+  {
+    bench->ArgNames({ "h", "w", "radius" });
+    for (const auto radius : { 1, 2, 4, 8, 16 })
+    {
+      for (const auto side : { 256, 1024, 4096 })
+        bench->Args({ side, side, radius });
+
+      bench->Args({ 4320, 7680, radius });
+    }
+  }
+
+  Image2d<float> random_image(ptrdiff_t h, ptrdiff_t w)
+  {
+    Image2d<float> img(h, w);
+
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<float> dist(0.f, 255.f);
+    foreach2d(img, y, x)
+      img(y, x) = dist(gen);
+
+    return img;
+  }
+
+  // Reports the throughput in pixels per second of the benchmarked image.
+  void set_pixel_rate(benchmark::State& state, ptrdiff_t h, ptrdiff_t w)
+  {
+    state.counters["pixels"] = benchmark::Counter(double(h * w), benchmark::Counter::kIsIterationInvariantRate);
+  }
+
+  void BM_FilterX(benchmark::State& state)
+  {
+    const auto h = state.range(0);
+    const auto w = state.range(1);
+    const auto bc = BorderCondition(state.range(2));
+
+    const auto src = random_image(h, w);
+    Image2d<float> dst(h, w);
+    const float kernel[] = { 0.05f, 0.25f, 0.4f, 0.25f, 0.05f };
+
+    for (auto _ : state)
+    {
+      filter_x(src, kernel, 5, bc, dst);
+      benchmark::DoNotOptimize(dst.data());
+    }
+
+    set_pixel_rate(state, h, w);
+  }
+  BENCHMARK(BM_FilterX)->Apply(image_sizes_and_border_conditions)->Unit(benchmark::kMillisecond);
+
+  void BM_FilterY(benchmark::State& state)
+  {
+    const auto h = state.range(0);
+    const auto w = state.range(1);
+    const auto bc = BorderCondition(state.range(2));
+
+    const auto src = random_image(h, w);
+    Image2d<float> dst(h, w);
+    const float kernel[] = { 0.05f, 0.25f, 0.4f, 0.25f, 0.05f };
+
+    for (auto _ : state)
+    {
+      filter_y(src, kernel, 5, bc, dst);
+      benchmark::DoNotOptimize(dst.data());
+    }
+
+    set_pixel_rate(state, h, w);
+  }
+  BENCHMARK(BM_FilterY)->Apply(image_sizes_and_border_conditions)->Unit(benchmark::kMillisecond);
+
+  void BM_GaussFilter(benchmark::State& state)
+  {
+    const auto h = state.range(0);
+    const auto w = state.range(1);
+    const auto radius = state.range(2);
+
+    const auto src = random_image(h, w);
+    Image2d<float> dst(h, w);
+    const auto sigma = float(radius) / 2.f;
+
+    for (auto _ : state)
+    {
+      gauss_filter(src, radius, radius, sigma, sigma, BorderCondition::BC_CLAMP, dst);
+      benchmark::DoNotOptimize(dst.data());
+    }
+
+    set_pixel_rate(state, h, w);
+  }
+  BENCHMARK(BM_GaussFilter)->Apply(image_sizes_and_radii)->Unit(benchmark::kMillisecond);
+
+  void BM_GaussPyramid(benchmark::State& state)
+  {
+    const auto h = state.range(0);
+    const auto w = state.range(1);
+
+    const auto src = random_image(h, w);
+    GaussPyramid pyramid;
+
+    for (auto _ : state)
+    {
+      pyramid.build(src.view(), 6);
+      benchmark::DoNotOptimize(pyramid.level(1).data());
+    }
+
+    set_pixel_rate(state, h, w);
+  }
+  BENCHMARK(BM_GaussPyramid)->Apply(image_sizes)->Unit(benchmark::kMillisecond);
+
+  // Display conversion of a result: the value range, then the 8 bit gray image.
+  void BM_ToDisplayGray(benchmark::State& state)
+  {
+    const auto h = state.range(0);
+    const auto w = state.range(1);
+
+    const auto src = random_image(h, w);
+    Image2d<unsigned char> dst(h, w);
+
+    for (auto _ : state)
+    {
+      const auto [min, max] = min_max_value(src);
+      to_display_gray(src.view(), min, max, dst.view());
+      benchmark::DoNotOptimize(dst.data());
+    }
+
+    set_pixel_rate(state, h, w);
+  }
+  BENCHMARK(BM_ToDisplayGray)->Apply(image_sizes)->Unit(benchmark::kMillisecond);
+
+  void BM_Rgb32ToGray(benchmark::State& state)
+  {
+    const auto h = state.range(0);
+    const auto w = state.range(1);
+
+    Image2d<uint32_t> src(h, w);
+    foreach2d(src, y, x)
+      src(y, x) = 0xff000000u | uint32_t(x * 2654435761u >> 8 ^ uint32_t(y) * 40503u);
+
+    Image2d<float> dst(h, w);
+
+    for (auto _ : state)
+    {
+      rgb32_to_gray(src.view(), dst.view());
+      benchmark::DoNotOptimize(dst.data());
+    }
+
+    set_pixel_rate(state, h, w);
+  }
+  BENCHMARK(BM_Rgb32ToGray)->Apply(image_sizes)->Unit(benchmark::kMillisecond);
+
+  void BM_SobelAbs(benchmark::State& state)
+  {
+    const auto h = state.range(0);
+    const auto w = state.range(1);
+
+    const auto src = random_image(h, w);
+    Image2d<float> dst(h, w);
+
+    for (auto _ : state)
+    {
+      sobel_abs(src, BorderCondition::BC_CLAMP, dst);
+      benchmark::DoNotOptimize(dst.data());
+    }
+
+    set_pixel_rate(state, h, w);
+  }
+  BENCHMARK(BM_SobelAbs)->Apply(image_sizes)->Unit(benchmark::kMillisecond);
+
+  void BM_Erode(benchmark::State& state)
+  {
+    const auto h = state.range(0);
+    const auto w = state.range(1);
+
+    const auto src = random_image(h, w);
+    Image2d<float> dst(h, w);
+
+    for (auto _ : state)
+    {
+      erode(src, 3, 3, BorderCondition::BC_CLAMP, dst);
+      benchmark::DoNotOptimize(dst.data());
+    }
+
+    set_pixel_rate(state, h, w);
+  }
+  BENCHMARK(BM_Erode)->Apply(image_sizes)->Unit(benchmark::kMillisecond);
+
+  void BM_CannyEdgeDetection(benchmark::State& state)
+  {
+    const auto h = state.range(0);
+    const auto w = state.range(1);
+
+    const auto src = random_image(h, w);
+    Image2d<unsigned char> dst(h, w);
+
+    for (auto _ : state)
+    {
+      canny_edge_detection(src, 50.f, 150.f, dst);
+      benchmark::DoNotOptimize(dst.data());
+    }
+
+    set_pixel_rate(state, h, w);
+  }
+  BENCHMARK(BM_CannyEdgeDetection)->Apply(image_sizes)->Unit(benchmark::kMillisecond);
+
+  // Blur, gradient and threshold, the chain the GUI typically runs.
+  void BM_ExecuteChain(benchmark::State& state, ExecutionMode mode)
+  {
+    const auto h = state.range(0);
+    const auto w = state.range(1);
+
+    const auto src = random_image(h, w);
+    Image2d<float> dst(h, w);
+
+    OperationChain chain;
+    chain.setExecutionMode(mode);
+    chain.addOperation(0, FilterConfig{ 2, 2, 1.f, 1.f });
+    chain.addOperation(1, GradConfig{ GradConfig::GradType::GradAbs });
+    chain.addOperation(2, ThresholdConfig{ 40.f, 255.f, 0.f });
+
+    for (auto _ : state)
+    {
+      chain.executeChain(src, dst);
+      benchmark::DoNotOptimize(dst.data());
+    }
+
+    set_pixel_rate(state, h, w);
+  }
+  BENCHMARK_CAPTURE(BM_ExecuteChain, staged, ExecutionMode::Staged)->Apply(image_sizes)->Unit(benchmark::kMillisecond);
+  BENCHMARK_CAPTURE(BM_ExecuteChain, fused, ExecutionMode::Fused)->Apply(image_sizes)->Unit(benchmark::kMillisecond);
+
+  // Many small patches, one call per patch against a single batch call.
+  void BM_ExecutePatches(benchmark::State& state, bool batch)
+  {
+    const auto n_patches = state.range(0);
+    const ptrdiff_t side = 256;
+
+    std::vector<Image2d<float>> patches;
+    std::vector<Image2d<float>> results;
+    for (ptrdiff_t i = 0; i < n_patches; ++i)
+    {
+      patches.push_back(random_image(side, side));
+      results.emplace_back(side, side);
+    }
+
+    OperationChain chain;
+    chain.addOperation(0, FilterConfig{ 2, 2, 1.f, 1.f });
+    chain.addOperation(1, GradConfig{ GradConfig::GradType::GradAbs });
+    chain.addOperation(2, ThresholdConfig{ 40.f, 255.f, 0.f });
+
+    for (auto _ : state)
+    {
+      if (batch)
+      {
+        chain.executeBatch(patches, results);
+      }
+      else
+      {
+        for (ptrdiff_t i = 0; i < n_patches; ++i)
+          chain.executeChain(patches[size_t(i)], results[size_t(i)]);
+      }
+
+      benchmark::DoNotOptimize(results.back().data());
+    }
+
+    set_pixel_rate(state, n_patches * side, side);
+  }
+  BENCHMARK_CAPTURE(BM_ExecutePatches, single, false)->Arg(64)->Arg(1024)->Unit(benchmark::kMillisecond);
+  BENCHMARK_CAPTURE(BM_ExecutePatches, batch, true)->Arg(64)->Arg(1024)->Unit(benchmark::kMillisecond);
+}
+
+BENCHMARK_MAIN();
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <Core/Core.hpp>
+
+#include <stdint.h>
+
+// Binary image with one bit per pixel, packed into 64 bit words: pixel x of a row is
+// bit x % 64 of word x / 64. The bits past the width are kept zero, so that rows can
+// be combined and counted a whole word at a time.
+class BinaryImage
+{
+public:
+  BinaryImage() = default;
+  explicit BinaryImage(ptrdiff_t h, ptrdiff_t w);
+  explicit BinaryImage(Position const& sz);
+
+  // Allocates a cleared image.
+  void alloc(ptrdiff_t h, ptrdiff_t w);
+  void alloc(Position const& sz);
+
+  ptrdiff_t width() const { return w_; }
+  ptrdiff_t height() const { return words_.height(); }
+  Position size() const { return Position(height(), width()); }
+
+  // Number of words holding the pixels of a row.
+  ptrdiff_t wordsPerRow() const { return words_.width(); }
+
+  uint64_t* row(ptrdiff_t y) { return words_.row(y); }
+  uint64_t const* row(ptrdiff_t y) const { return words_.row(y); }
+
+  bool operator()(ptrdiff_t y, ptrdiff_t x) const
+  {
+    return (row(y)[x / 64] >> (x % 64)) & 1;
+  }
+
+  void set(ptrdiff_t y, ptrdiff_t x, bool value)
+  {
+    const auto bit = uint64_t(1) << (x % 64);
+    auto& word = row(y)[x / 64];
+    word = value ? (word | bit) : (word & ~bit);
+  }
+
+  void fill(bool value);
+
+  // Number of set pixels.
+  size_t count() const;
+
+  // The words of the image, wordsPerRow() wide.
+  ImageView<uint64_t> words() { return words_.view(); }
+  ImageView<uint64_t const> words() const { return words_.view(); }
+
+  // Mask of the valid bits of the last word of a row.
+  uint64_t lastWordMask() const;
+
+private:
+  ptrdiff_t w_ = 0;
+  Image2d<uint64_t> words_;
+};
+
+// Logical operations, dst is reallocated if its size differs from the sources.
+void binary_and(BinaryImage const& a, BinaryImage const& b, BinaryImage& dst);
+void binary_or(BinaryImage const& a, BinaryImage const& b, BinaryImage& dst);
+void binary_xor(BinaryImage const& a, BinaryImage const& b, BinaryImage& dst);
+void binary_not(BinaryImage const& src, BinaryImage& dst);
+
+// Erosion and dilation with a (2 * kernel_radius_y + 1) x (2 * kernel_radius_x + 1)
+// rectangle, pixels outside of the image do not take part (as BC_CLAMP for Image2d).
+// Rows are shifted a word at a time and the rectangle is built from log2 of its
+// width shifts, the columns combine whole words with van Herk/Gil-Werman.
+void erode(BinaryImage const& src, ptrdiff_t kernel_radius_y, ptrdiff_t kernel_radius_x, BinaryImage& dst);
+void dilate(BinaryImage const& src, ptrdiff_t kernel_radius_y, ptrdiff_t kernel_radius_x, BinaryImage& dst);
+
+namespace detail
+{
+  // Packs src_row[x] >= threshold into the bits of dst_row.
+  template<typename T>
+  void threshold_pack_row(T const* src_row, ptrdiff_t width, T threshold, uint64_t* dst_row)
+  {
+    for (ptrdiff_t j0 = 0; j0 < width; j0 += 64)
+    {
+      const auto n = std::min<ptrdiff_t>(64, width - j0);
+      uint64_t word = 0;
+      for (ptrdiff_t j = 0; j < n; ++j)
+        word |= uint64_t(src_row[j0 + j] >= threshold) << j;
+
+      dst_row[j0 / 64] = word;
+    }
+  }
+}
+
+// Sets the pixels with src >= threshold, like threshold_image. dst is reallocated if
+// its size differs from src.
+template<typename T>
+void threshold_image(ConstImageView<T> src, T threshold, BinaryImage& dst)
+{
+  if (dst.height() != src.height() || dst.width() != src.width())
+    dst.alloc(src.size());
+
+  parallel_for_rows(src.height(), src.width(), [&](ptrdiff_t row_begin, ptrdiff_t row_end)
+    {
+      for (ptrdiff_t i = row_begin; i < row_end; ++i)
+        detail::threshold_pack_row(src.row(i), src.width(), threshold, dst.row(i));
+    });
+}
+
+template<typename T>
+void threshold_image(Image2d<T> const& src, T threshold, BinaryImage& dst)
+{
+  threshold_image<T>(src.view(), threshold, dst);
+}
+
+// Sets the non-zero pixels of src.
+template<typename T>
+void to_binary(ConstImageView<T> src, BinaryImage& dst)
+{
+  if (dst.height() != src.height() || dst.width() != src.width())
+    dst.alloc(src.size());
+
+  parallel_for_rows(src.height(), src.width(), [&](ptrdiff_t row_begin, ptrdiff_t row_end)
+    {
+      for (ptrdiff_t i = row_begin; i < row_end; ++i)
+      {
+        const auto src_row = src.row(i);
+        const auto dst_row = dst.row(i);
+        for (ptrdiff_t j0 = 0; j0 < src.width(); j0 += 64)
+        {
+          const auto n = std::min<ptrdiff_t>(64, src.width() - j0);
+          uint64_t word = 0;
+          for (ptrdiff_t j = 0; j < n; ++j)
+            word |= uint64_t(src_row[j0 + j] != T(0)) << j;
+
+          dst_row[j0 / 64] = word;
+        }
+      }
+    });
+}
+
+template<typename T>
+void to_binary(Image2d<T> const& src, BinaryImage& dst)
+{
+  to_binary<T>(src.view(), dst);
+}
+
+// Writes true_val for the set pixels of src and false_val for the others.
+template<typename T>
+void from_binary(BinaryImage const& src, detail::type_identity_t<T> true_val, detail::type_identity_t<T> false_val, ImageView<T> dst)
+{
+  parallel_for_rows(src.height(), src.width(), [&](ptrdiff_t row_begin, ptrdiff_t row_end)
+    {
+      for (ptrdiff_t i = row_begin; i < row_end; ++i)
+      {
+        const auto src_row = src.row(i);
+        const auto dst_row = dst.row(i);
+        for (ptrdiff_t j0 = 0; j0 < src.width(); j0 += 64)
+        {
+          const auto n = std::min<ptrdiff_t>(64, src.width() - j0);
+          const auto word = src_row[j0 / 64];
+          for (ptrdiff_t j = 0; j < n; ++j)
+            dst_row[j0 + j] = ((word >> j) & 1) ? true_val : false_val;
+        }
+      }
+    });
+}
+
+template<typename T>
+void from_binary(BinaryImage const& src, detail::type_identity_t<T> true_val, detail::type_identity_t<T> false_val, Image2d<T>& dst)
+{
+  if (dst.height() != src.height() || dst.width() != src.width())
+    dst.allocUninitialized(src.size());
+
+  from_binary(src, true_val, false_val, dst.view());
+}
@@ -1,10 +1,23 @@
 #pragma once
 
+#include <Core/Memory.hpp>
 #include <Core/OpConfigDefines.hpp>
-
+#include <Core/Parallel.hpp>
+#include <Core/Simd.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <type_traits>
 #include <fstream>
+#include <limits>
+#include <utility>
+#include <variant>
 #include <vector>
 
 #define foreach2d(img, y, x) \
@@ -46,15 +59,50 @@ struct Position
 namespace detail
 {
   bool is_in_range(ptrdiff_t i, ptrdiff_t lo, ptrdiff_t hi);
+
+  // Row stride (in elements) of an image of width w with the given row padding,
+  // such that every row is aligned to image_row_alignment.
+  template<typename T>
+  ptrdiff_t aligned_stride(ptrdiff_t w, ptrdiff_t row_padding)
+  {
+    constexpr auto row_alignment = ptrdiff_t(image_row_alignment / sizeof(T));
+    const auto min_stride = w + row_padding;
+    return (min_stride + row_alignment - 1) / row_alignment * row_alignment;
+  }
+
+  template<typename T>
+  struct type_identity
+  {
+    using type = T;
+  };
+
+  // Excludes a parameter from template argument deduction.
+  template<typename T>
+  using type_identity_t = typename type_identity<T>::type;
 }
 
+template<typename T>
+class ImageView;
+
+// Tag selecting the allocation path that leaves the pixel values uninitialized.
+struct NoInit {};
+constexpr NoInit no_init{};
+
+// Two-dimensional image stored row by row. Every row starts at an address aligned
+// to detail::image_row_alignment, so consecutive rows are stride() elements apart,
+// which may be more than width(). Optional row padding adds extra elements to
+// each row, e.g. to avoid 4K aliasing on power-of-two widths.
 template<typename T>
 class Image2d
 {
 public:
   Image2d() = default;
-  explicit Image2d(ptrdiff_t h, ptrdiff_t w);
-  explicit Image2d(Position const& sz);
+  explicit Image2d(ptrdiff_t h, ptrdiff_t w, ptrdiff_t row_padding = 0);
+  explicit Image2d(Position const& sz, ptrdiff_t row_padding = 0);
+
+  // Allocates without zeroing the pixels, for images that are fully overwritten anyway.
+  explicit Image2d(ptrdiff_t h, ptrdiff_t w, NoInit, ptrdiff_t row_padding = 0);
+  explicit Image2d(Position const& sz, NoInit, ptrdiff_t row_padding = 0);
 
   Image2d(Image2d<T> const& other) = delete;
   Image2d(Image2d<T>&& other);
@@ -66,17 +114,30 @@ public:
   ptrdiff_t height() const;
   Position size() const;
 
+  // Distance between the starts of two consecutive rows, in elements.
+  ptrdiff_t stride() const;
+
   T* data();
   T const * data() const;
 
+  T* row(ptrdiff_t y);
+  T const* row(ptrdiff_t y) const;
+
   T& operator()(ptrdiff_t y, ptrdiff_t x);
   T const& operator()(ptrdiff_t y, ptrdiff_t x) const;
 
   T& operator()(Position pos);
   T const& operator()(Position pos) const;
 
-  void alloc(ptrdiff_t h, ptrdiff_t w);
-  void alloc(Position const& sz);
+  void alloc(ptrdiff_t h, ptrdiff_t w, ptrdiff_t row_padding = 0);
+  void alloc(Position const& sz, ptrdiff_t row_padding = 0);
+
+  // Same as alloc(), but the pixel values are left uninitialized.
+  void allocUninitialized(ptrdiff_t h, ptrdiff_t w, ptrdiff_t row_padding = 0);
+  void allocUninitialized(Position const& sz, ptrdiff_t row_padding = 0);
+
+  ImageView<T> view();
+  ImageView<T const> view() const;
 
   bool isValid(ptrdiff_t y, ptrdiff_t x) const
   {
@@ -89,19 +150,38 @@ public:
   }
 
 private:
+  void allocImpl(ptrdiff_t h, ptrdiff_t w, ptrdiff_t row_padding, bool zero_init);
+
   ptrdiff_t h_ = 0;
   ptrdiff_t w_ = 0;
-  std::unique_ptr<T[]> data_ = nullptr;
+  ptrdiff_t stride_ = 0;
+  detail::AlignedBuffer buffer_ = nullptr;
+  T* data_ = nullptr;
 };
 
 template<typename T>
-inline Image2d<T>::Image2d(ptrdiff_t h, ptrdiff_t w) : h_(h), w_(w), data_(std::make_unique<T[]>(h * w))
+inline Image2d<T>::Image2d(ptrdiff_t h, ptrdiff_t w, ptrdiff_t row_padding)
+{
+  static_assert(std::is_arithmetic_v<T>, "Image2d template type needs to be of arithmetic type.");
+  static_assert(detail::image_row_alignment % sizeof(T) == 0, "Image2d row alignment needs to be a multiple of the element size.");
+
+  alloc(h, w, row_padding);
+}
+
+template<typename T>
+inline Image2d<T>::Image2d(Position const& sz, ptrdiff_t row_padding) : Image2d<T>(sz.y, sz.x, row_padding) {}
+
+template<typename T>
+inline Image2d<T>::Image2d(ptrdiff_t h, ptrdiff_t w, NoInit, ptrdiff_t row_padding)
 {
   static_assert(std::is_arithmetic_v<T>, "Image2d template type needs to be of arithmetic type.");
+  static_assert(detail::image_row_alignment % sizeof(T) == 0, "Image2d row alignment needs to be a multiple of the element size.");
+
+  allocUninitialized(h, w, row_padding);
 }
 
 template<typename T>
-inline Image2d<T>::Image2d(Position const& sz) : Image2d<T>(sz.y, sz.x) {}
+inline Image2d<T>::Image2d(Position const& sz, NoInit, ptrdiff_t row_padding) : Image2d<T>(sz.y, sz.x, no_init, row_padding) {}
 
 template<typename T>
 inline Image2d<T>::Image2d(Image2d<T>&& other)
@@ -114,10 +194,14 @@ inline Image2d<T>& Image2d<T>::operator=(Image2d<T>&& other)
 {
   h_ = other.h_;
   w_ = other.w_;
-  data_ = std::move(other.data_);
+  stride_ = other.stride_;
+  buffer_ = std::move(other.buffer_);
+  data_ = other.data_;
 
   other.h_ = 0;
   other.w_ = 0;
+  other.stride_ = 0;
+  other.data_ = nullptr;
 
   return *this;
 }
@@ -140,58 +224,227 @@ inline Position Image2d<T>::size() const
   return Position(h_, w_);
 }
 
+template<typename T>
+inline ptrdiff_t Image2d<T>::stride() const
+{
+  return stride_;
+}
+
 template<typename T>
 inline T* Image2d<T>::data()
 {
-  return data_.get();
+  return data_;
 }
 
 template<typename T>
 inline T const* Image2d<T>::data() const
 {
-  return data_.get();
+  return data_;
+}
+
+template<typename T>
+inline T* Image2d<T>::row(ptrdiff_t y)
+{
+  return data_ + y * stride_;
+}
+
+template<typename T>
+inline T const* Image2d<T>::row(ptrdiff_t y) const
+{
+  return data_ + y * stride_;
 }
 
 template<typename T>
 inline T& Image2d<T>::operator()(ptrdiff_t y, ptrdiff_t x)
 {
-  return data_[y * w_ + x];
+  return data_[y * stride_ + x];
 }
 
 template<typename T>
 inline T const& Image2d<T>::operator()(ptrdiff_t y, ptrdiff_t x) const
 {
-  return data_[y * w_ + x];
+  return data_[y * stride_ + x];
 }
 
 template<typename T>
 inline T& Image2d<T>::operator()(Position pos)
 {
-  return data_[pos.y * w_ + pos.x];
+  return data_[pos.y * stride_ + pos.x];
 }
 
 template<typename T>
 inline T const& Image2d<T>::operator()(Position pos) const
 {
-  return data_[pos.y * w_ + pos.x];
+  return data_[pos.y * stride_ + pos.x];
+}
+
+template<typename T>
+inline void Image2d<T>::alloc(ptrdiff_t h, ptrdiff_t w, ptrdiff_t row_padding)
+{
+  allocImpl(h, w, row_padding, true);
+}
+
+template<typename T>
+inline void Image2d<T>::alloc(Position const& sz, ptrdiff_t row_padding)
+{
+  alloc(sz.y, sz.x, row_padding);
 }
 
 template<typename T>
-inline void Image2d<T>::alloc(ptrdiff_t h, ptrdiff_t w)
+inline void Image2d<T>::allocUninitialized(ptrdiff_t h, ptrdiff_t w, ptrdiff_t row_padding)
+{
+  allocImpl(h, w, row_padding, false);
+}
+
+template<typename T>
+inline void Image2d<T>::allocUninitialized(Position const& sz, ptrdiff_t row_padding)
+{
+  allocUninitialized(sz.y, sz.x, row_padding);
+}
+
+template<typename T>
+inline void Image2d<T>::allocImpl(ptrdiff_t h, ptrdiff_t w, ptrdiff_t row_padding, bool zero_init)
 {
   h_ = h;
   w_ = w;
-  data_ = std::make_unique<T[]>(h * w);
+  stride_ = detail::aligned_stride<T>(w, row_padding);
+  buffer_ = detail::alloc_aligned_buffer(size_t(h * stride_) * sizeof(T), zero_init);
+  data_ = reinterpret_cast<T*>(buffer_.get());
+}
+
+// Non-owning view of a (sub-)image: a pointer to the first pixel, the size and
+// the row stride of the underlying buffer. Views are cheap to copy and are used
+// to process ROIs, row bands and tiles without copying. ImageView<T const> is
+// a read-only view; a mutable view converts to it implicitly.
+template<typename T>
+class ImageView
+{
+public:
+  using value_type = std::remove_const_t<T>;
+
+  ImageView() = default;
+  explicit ImageView(T* data, ptrdiff_t h, ptrdiff_t w, ptrdiff_t stride) :
+    h_(h), w_(w), stride_(stride), data_(data) {}
+
+  ImageView(Image2d<value_type>& img) : 
+    ImageView(img.data(), img.height(), img.width(), img.stride()) {}
+
+  template<typename U = T, typename = std::enable_if_t<std::is_const_v<U>>>
+  ImageView(Image2d<value_type> const& img) :
+    ImageView(img.data(), img.height(), img.width(), img.stride()) {}
+
+  template<typename U = T, typename = std::enable_if_t<std::is_const_v<U>>>
+  ImageView(ImageView<value_type> const& other) :
+    ImageView(other.data(), other.height(), other.width(), other.stride()) {}
+
+  ptrdiff_t width() const { return w_; }
+  ptrdiff_t height() const { return h_; }
+  Position size() const { return Position(h_, w_); }
+  ptrdiff_t stride() const { return stride_; }
+
+  T* data() const { return data_; }
+  T* row(ptrdiff_t y) const { return data_ + y * stride_; }
+
+  T& operator()(ptrdiff_t y, ptrdiff_t x) const { return data_[y * stride_ + x]; }
+  T& operator()(Position pos) const { return data_[pos.y * stride_ + pos.x]; }
+
+  // Rectangular region of h x w pixels with the top left corner at (y, x).
+  ImageView roi(ptrdiff_t y, ptrdiff_t x, ptrdiff_t h, ptrdiff_t w) const
+  {
+    return ImageView(row(y) + x, h, w, stride_);
+  }
+
+  ImageView roi(Position const& pos, Position const& sz) const
+  {
+    return roi(pos.y, pos.x, sz.y, sz.x);
+  }
+
+  // Full-width band of rows [y_begin, y_end).
+  ImageView rows(ptrdiff_t y_begin, ptrdiff_t y_end) const
+  {
+    return ImageView(row(y_begin), y_end - y_begin, w_, stride_);
+  }
+
+  bool isValid(ptrdiff_t y, ptrdiff_t x) const
+  {
+    return detail::is_in_range(y, 0, h_) && detail::is_in_range(x, 0, w_);
+  }
+
+  bool isValid(Position pos) const
+  {
+    return isValid(pos.y, pos.x);
+  }
+
+private:
+  ptrdiff_t h_ = 0;
+  ptrdiff_t w_ = 0;
+  ptrdiff_t stride_ = 0;
+  T* data_ = nullptr;
+};
+
+// Read-only view of the source image. The element type is deduced from the other
+// arguments, so Image2d and mutable views can be passed directly.
+template<typename T>
+using ConstImageView = ImageView<detail::type_identity_t<T> const>;
+
+template<typename T>
+inline ImageView<T> Image2d<T>::view()
+{
+  return ImageView<T>(*this);
 }
 
 template<typename T>
-inline void Image2d<T>::alloc(Position const& sz)
+inline ImageView<T const> Image2d<T>::view() const
 {
-  alloc(sz.y, sz.x);
+  return ImageView<T const>(*this);
 }
 
+// Temporary image drawn from ImagePool::global() and returned to it on destruction.
+// Its pixel values are undefined until written.
 template<typename T>
-void fill(Image2d<T>& img, T val)
+class ScratchImage
+{
+public:
+  explicit ScratchImage(ptrdiff_t h, ptrdiff_t w)
+  {
+    const auto stride = detail::aligned_stride<T>(w, 0);
+    bytes_ = size_t(h * stride) * sizeof(T);
+    if (bytes_ > 0)
+    {
+      buffer_ = ImagePool::global().acquire(bytes_);
+    }
+
+    view_ = ImageView<T>(reinterpret_cast<T*>(buffer_.get()), h, w, stride);
+  }
+
+  explicit ScratchImage(Position const& sz) : ScratchImage(sz.y, sz.x) {}
+
+  ScratchImage(ScratchImage<T> const& other) = delete;
+  ScratchImage& operator=(ScratchImage<T> const& other) = delete;
+
+  ~ScratchImage()
+  {
+    ImagePool::global().release(std::move(buffer_), bytes_);
+  }
+
+  ptrdiff_t width() const { return view_.width(); }
+  ptrdiff_t height() const { return view_.height(); }
+  Position size() const { return view_.size(); }
+
+  ImageView<T> view() { return view_; }
+  ImageView<T const> view() const { return view_; }
+
+  T& operator()(ptrdiff_t y, ptrdiff_t x) { return view_(y, x); }
+  T const& operator()(ptrdiff_t y, ptrdiff_t x) const { return view_(y, x); }
+
+private:
+  size_t bytes_ = 0;
+  detail::AlignedBuffer buffer_ = nullptr;
+  ImageView<T> view_;
+};
+
+template<typename T>
+void fill(ImageView<T> img, detail::type_identity_t<T> val)
 {
   foreach2d(img, y, x)
   {
@@ -199,8 +452,14 @@ void fill(Image2d<T>& img, T val)
   }
 }
 
+template<typename T>
+void fill(Image2d<T>& img, T val)
+{
+  fill(img.view(), val);
+}
+
 template<typename T, typename U>
-void fill(Image2d<T>& img, Image2d<U> const& other)
+void fill(ImageView<T> img, ImageView<U> other)
 {
   foreach2d(img, y, x)
   {
@@ -208,48 +467,170 @@ void fill(Image2d<T>& img, Image2d<U> const& other)
   }
 }
 
+template<typename T, typename U>
+void fill(Image2d<T>& img, Image2d<U> const& other)
+{
+  fill(img.view(), other.view());
+}
+
+// Pixel types of the images passed between the stages of an OperationChain.
+enum class PixelType { U8, U16, F32 };
+
+// Images and views of any of the pixel types, the alternatives follow the order of PixelType.
+using AnyImage = std::variant<Image2d<unsigned char>, Image2d<uint16_t>, Image2d<float>>;
+using AnyImageView = std::variant<ImageView<unsigned char>, ImageView<uint16_t>, ImageView<float>>;
+using AnyConstImageView = std::variant<ImageView<unsigned char const>, ImageView<uint16_t const>, ImageView<float const>>;
+
+namespace detail
+{
+  template<typename T>
+  struct pixel_type_of;
+
+  template<>
+  struct pixel_type_of<unsigned char>
+  {
+    static constexpr PixelType value = PixelType::U8;
+  };
+
+  template<>
+  struct pixel_type_of<uint16_t>
+  {
+    static constexpr PixelType value = PixelType::U16;
+  };
+
+  template<>
+  struct pixel_type_of<float>
+  {
+    static constexpr PixelType value = PixelType::F32;
+  };
+
+  // Rounds and saturates when converting to an integer type, NaN becomes the minimum.
+  template<typename U, typename T>
+  U convert_pixel(T val)
+  {
+    if constexpr (std::is_integral_v<U> && (std::is_floating_point_v<T> || sizeof(T) > sizeof(U)))
+    {
+      const auto lo = double(std::numeric_limits<U>::min());
+      const auto hi = double(std::numeric_limits<U>::max());
+      const auto rounded = std::is_floating_point_v<T> ? std::round(double(val)) : double(val);
+      return static_cast<U>(rounded > lo ? (rounded < hi ? rounded : hi) : lo);
+    }
+    else
+    {
+      return static_cast<U>(val);
+    }
+  }
+}
+
 template<typename T>
-void add(Image2d<T> const& src1, T src2, Image2d<T>& dst)
+constexpr PixelType pixel_type_v = detail::pixel_type_of<std::remove_const_t<T>>::value;
+
+PixelType pixel_type(AnyConstImageView const& img);
+PixelType pixel_type(AnyImageView const& img);
+PixelType pixel_type(AnyImage const& img);
+
+Position image_size(AnyConstImageView const& img);
+
+AnyConstImageView const_view(AnyImageView const& img);
+AnyImageView any_view(AnyImage& img);
+AnyConstImageView any_view(AnyImage const& img);
+
+// Converts the pixel values to the type of dst, see detail::convert_pixel.
+template<typename T, typename U>
+void convert_image(ImageView<T const> src, ImageView<U> dst)
+{
+  parallel_for_rows(src.height(), src.width(), [&](ptrdiff_t row_begin, ptrdiff_t row_end)
+    {
+      for (ptrdiff_t i = row_begin; i < row_end; ++i)
+      {
+        const auto src_row = src.row(i);
+        const auto dst_row = dst.row(i);
+        for (ptrdiff_t j = 0; j < src.width(); ++j)
+          dst_row[j] = detail::convert_pixel<U>(src_row[j]);
+      }
+    });
+}
+
+void convert_image(AnyConstImageView const& src, AnyImageView const& dst);
+
+template<typename T>
+void add(ConstImageView<T> src1, detail::type_identity_t<T> src2, ImageView<T> dst)
 {
   foreach2d(dst, y, x)
     dst(y, x) = src1(y, x) + src2;
 }
 
 template<typename T>
-void add(Image2d<T> const& src1, Image2d<T> const& src2, Image2d<T>& dst)
+void add(Image2d<T> const& src1, T src2, Image2d<T>& dst)
+{
+  add(src1.view(), src2, dst.view());
+}
+
+template<typename T>
+void add(ConstImageView<T> src1, ConstImageView<T> src2, ImageView<T> dst)
 {
   foreach2d(dst, y, x)
     dst(y, x) = src1(y, x) + src2(y, x);
 }
 
 template<typename T>
-void sub(Image2d<T> const& src1, T src2, Image2d<T>& dst)
+void add(Image2d<T> const& src1, Image2d<T> const& src2, Image2d<T>& dst)
+{
+  add(src1.view(), src2.view(), dst.view());
+}
+
+template<typename T>
+void sub(ConstImageView<T> src1, detail::type_identity_t<T> src2, ImageView<T> dst)
 {
   foreach2d(dst, y, x)
     dst(y, x) = src1(y, x) - src2;
 }
 
 template<typename T>
-void sub(Image2d<T> const& src1, Image2d<T> const& src2, Image2d<T>& dst)
+void sub(Image2d<T> const& src1, T src2, Image2d<T>& dst)
+{
+  sub(src1.view(), src2, dst.view());
+}
+
+template<typename T>
+void sub(ConstImageView<T> src1, ConstImageView<T> src2, ImageView<T> dst)
 {
   foreach2d(dst, y, x)
     dst(y, x) = src1(y, x) - src2(y, x);
 }
 
 template<typename T>
-void mul(Image2d<T> const& src1, T src2, Image2d<T>& dst)
+void sub(Image2d<T> const& src1, Image2d<T> const& src2, Image2d<T>& dst)
+{
+  sub(src1.view(), src2.view(), dst.view());
+}
+
+template<typename T>
+void mul(ConstImageView<T> src1, detail::type_identity_t<T> src2, ImageView<T> dst)
 {
   foreach2d(dst, y, x)
     dst(y, x) = src1(y, x) * src2;
 }
 
 template<typename T>
-void mul(Image2d<T> const& src1, Image2d<T> const& src2, Image2d<T>& dst)
+void mul(Image2d<T> const& src1, T src2, Image2d<T>& dst)
+{
+  mul(src1.view(), src2, dst.view());
+}
+
+template<typename T>
+void mul(ConstImageView<T> src1, ConstImageView<T> src2, ImageView<T> dst)
 {
   foreach2d(dst, y, x)
     dst(y, x) = src1(y, x) * src2(y, x);
 }
 
+template<typename T>
+void mul(Image2d<T> const& src1, Image2d<T> const& src2, Image2d<T>& dst)
+{
+  mul(src1.view(), src2.view(), dst.view());
+}
+
 template<typename T>
 T sum(Image2d<T> const& src)
 {
@@ -280,466 +661,1548 @@ T max_value(Image2d<T> const& src)
   return max;
 }
 
+namespace detail
+{
+  // Extends [min, max] by the values of a row.
+  template<typename T>
+  void min_max_row(T const* src_row, ptrdiff_t width, T& min, T& max)
+  {
+    for (ptrdiff_t j = 0; j < width; ++j)
+    {
+      min = src_row[j] < min ? src_row[j] : min;
+      max = src_row[j] > max ? src_row[j] : max;
+    }
+  }
+}
+
+// Minimum and maximum of a non-empty image in a single pass over parallel row bands.
+template<typename T>
+std::pair<T, T> min_max_value(ConstImageView<T> src)
+{
+  std::mutex mutex;
+  auto min = src(0, 0);
+  auto max = min;
+  parallel_for_rows(src.height(), src.width(), [&](ptrdiff_t row_begin, ptrdiff_t row_end)
+    {
+      auto band_min = src(row_begin, 0);
+      auto band_max = band_min;
+      for (ptrdiff_t i = row_begin; i < row_end; ++i)
+        detail::min_max_row(src.row(i), src.width(), band_min, band_max);
+
+      std::lock_guard<std::mutex> lock(mutex);
+      min = band_min < min ? band_min : min;
+      max = band_max > max ? band_max : max;
+    });
+
+  return { min, max };
+}
+
+template<typename T>
+std::pair<T, T> min_max_value(Image2d<T> const& src)
+{
+  return min_max_value<T>(src.view());
+}
+
+namespace constants
+{
+  constexpr const double pi = 3.14159265359;
+  constexpr const double two_pi = pi * 2.;
+  constexpr const double half_pi = pi / 2.;
+  constexpr const double quarter_pi = pi / 4.;
+  constexpr const double eighth_pi = pi / 8.;
+}
+
 enum class BorderCondition {
   BC_ZERO,
   BC_CLAMP,
   BC_WRAP
 };
 
-template<typename T>
-void filter_x(Image2d<T> const& src, T const* kernel, ptrdiff_t kernel_sz, BorderCondition bc, Image2d<T>& dst)
+namespace detail
 {
-  // Handle inner pixels (avoiding boundary conditions).
-  const ptrdiff_t kernel_radius = kernel_sz / 2;
-  for(ptrdiff_t i = 0; i < src.height(); ++i)
-    for (ptrdiff_t j = kernel_radius; j < src.width() - kernel_radius; ++j)
+  // Index of the sample at position k of a line of n samples under the given border
+  // condition, or -1 if the sample is zero.
+  ptrdiff_t border_index(ptrdiff_t k, ptrdiff_t n, BorderCondition bc);
+
+  template<typename T>
+  void filter_x_inner_row(T const* src_row, T const* kernel, ptrdiff_t kernel_sz, ptrdiff_t width, T* dst_row)
+  {
+    const ptrdiff_t kernel_radius = kernel_sz / 2;
+    for (ptrdiff_t j = kernel_radius; j < width - kernel_radius; ++j)
     {
       const ptrdiff_t j_begin = j - kernel_radius;
       T filtered = T(0);
       for(ptrdiff_t ik = 0; ik < kernel_sz; ++ik)
-        filtered += kernel[ik] * src(i, j_begin + ik);
+        filtered += kernel[ik] * src_row[j_begin + ik];
 
-      dst(i, j) = filtered;
+      dst_row[j] = filtered;
     }
+  }
 
-  // Handle border pixels.
-  switch (bc)
+  template<typename T>
+  void filter_y_inner_row(T const* src_rows, ptrdiff_t src_stride, T const* kernel, ptrdiff_t kernel_sz, 
+    ptrdiff_t width, T* dst_row)
   {
-  case BorderCondition::BC_ZERO:
+    for (ptrdiff_t j = 0; j < width; ++j)
+    {
+      T filtered = T(0);
+      for(ptrdiff_t ik = 0; ik < kernel_sz; ++ik)
+        filtered += kernel[ik] * src_rows[ik * src_stride + j];
+
+      dst_row[j] = filtered;
+    }
+  }
+
+  template<typename T>
+  void filter_x_rows(ConstImageView<T> src, T const* kernel, ptrdiff_t kernel_sz, BorderCondition bc, ImageView<T> dst,
+    ptrdiff_t row_begin, ptrdiff_t row_end)
   {
-    // Left border pixels.
-    for(ptrdiff_t i = 0; i < src.height(); ++i)
-      for (ptrdiff_t j = 0; j < kernel_radius; ++j)
-      {
-        const auto j_begin = j - kernel_radius;
-        const auto k_begin = -j_begin;
+    // Rows narrower than the kernel have pixels at both borders, every tap follows the border condition.
+    const ptrdiff_t kernel_radius = kernel_sz / 2;
+    if (src.width() < kernel_sz)
+    {
+      for(ptrdiff_t i = row_begin; i < row_end; ++i)
+        for (ptrdiff_t j = 0; j < src.width(); ++j)
+        {
+          T filtered = T(0);
+          for(ptrdiff_t ik = 0; ik < kernel_sz; ++ik)
+          {
+            const auto index = border_index(j - kernel_radius + ik, src.width(), bc);
+            if (index >= 0)
+              filtered += kernel[ik] * src(i, index);
+          }
+
+          dst(i, j) = filtered;
+        }
+      return;
+    }
 
-        T filtered = T(0);
-        for(ptrdiff_t ik = k_begin; ik < kernel_sz; ++ik)
-          filtered += kernel[ik] * src(i, j_begin + ik);
+    // Handle inner pixels (avoiding boundary conditions).
+    for(ptrdiff_t i = row_begin; i < row_end; ++i)
+      filter_x_inner_row(src.row(i), kernel, kernel_sz, src.width(), dst.row(i));
 
-        dst(i, j) = filtered;
-      }
+    // Handle border pixels.
+    switch (bc)
+    {
+    case BorderCondition::BC_ZERO:
+    {
+      // Left border pixels.
+      for(ptrdiff_t i = row_begin; i < row_end; ++i)
+        for (ptrdiff_t j = 0; j < kernel_radius; ++j)
+        {
+          const auto j_begin = j - kernel_radius;
+          const auto k_begin = -j_begin;
 
-    // Right border pixels.
-    for(ptrdiff_t i = 0; i < src.height(); ++i)
-      for (ptrdiff_t j = src.width() - kernel_radius; j < src.width(); ++j)
-      {
-        const auto j_begin = j - kernel_radius;
-        const auto k_end = src.width() - j_begin;
+          T filtered = T(0);
+          for(ptrdiff_t ik = k_begin; ik < kernel_sz; ++ik)
+            filtered += kernel[ik] * src(i, j_begin + ik);
 
-        T filtered = T(0);
-        for(ptrdiff_t ik = 0; ik < k_end; ++ik)
-          filtered += kernel[ik] * src(i, j_begin + ik);
+          dst(i, j) = filtered;
+        }
 
-        dst(i, j) = filtered;
-      }
+      // Right border pixels.
+      for(ptrdiff_t i = row_begin; i < row_end; ++i)
+        for (ptrdiff_t j = src.width() - kernel_radius; j < src.width(); ++j)
+        {
+          const auto j_begin = j - kernel_radius;
+          const auto k_end = src.width() - j_begin;
+
+          T filtered = T(0);
+          for(ptrdiff_t ik = 0; ik < k_end; ++ik)
+            filtered += kernel[ik] * src(i, j_begin + ik);
+
+          dst(i, j) = filtered;
+        }
+    }
+    break;
+    case BorderCondition::BC_CLAMP:
+    {
+      // Left border pixels.
+      for(ptrdiff_t i = row_begin; i < row_end; ++i)
+        for (ptrdiff_t j = 0; j < kernel_radius; ++j)
+        {
+          const auto j_begin = j - kernel_radius;
+          const auto k_begin = -j_begin;
+
+          T filtered = T(0);
+          for(ptrdiff_t ik = k_begin; ik < kernel_sz; ++ik)
+            filtered += kernel[ik] * src(i, j_begin + ik);
+
+          for (ptrdiff_t ik = 0; ik < k_begin; ++ik)
+            filtered += kernel[ik] * src(i, 0);
+
+          dst(i, j) = filtered;
+        }
+
+      // Right border pixels.
+      for(ptrdiff_t i = row_begin; i < row_end; ++i)
+        for (ptrdiff_t j = src.width() - kernel_radius; j < src.width(); ++j)
+        {
+          const auto j_begin = j - kernel_radius;
+          const auto k_end = src.width() - j_begin;
+
+          T filtered = T(0);
+          for(ptrdiff_t ik = 0; ik < k_end; ++ik)
+            filtered += kernel[ik] * src(i, j_begin + ik);
+
+          for (ptrdiff_t ik = k_end; ik < kernel_sz; ++ik)
+            filtered += kernel[ik] * src(i, src.width() - 1);
+
+          dst(i, j) = filtered;
+        }
+    }
+    break;
+    case BorderCondition::BC_WRAP:
+    {
+      // Left border pixels.
+      for(ptrdiff_t i = row_begin; i < row_end; ++i)
+        for (ptrdiff_t j = 0; j < kernel_radius; ++j)
+        {
+          const auto j_begin = j - kernel_radius;
+          const auto k_begin = -j_begin;
+
+          T filtered = T(0);
+          for(ptrdiff_t ik = k_begin; ik < kernel_sz; ++ik)
+            filtered += kernel[ik] * src(i, j_begin + ik);
+
+          const auto wrap_begin = src.width() - k_begin;
+          for (ptrdiff_t ik = 0; ik < k_begin; ++ik)
+            filtered += kernel[ik] * src(i, wrap_begin + ik);
+
+          dst(i, j) = filtered;
+        }
+
+      // Right border pixels.
+      for(ptrdiff_t i = row_begin; i < row_end; ++i)
+        for (ptrdiff_t j = src.width() - kernel_radius; j < src.width(); ++j)
+        {
+          const auto j_begin = j - kernel_radius;
+          const auto k_end = src.width() - j_begin;
+
+          T filtered = T(0);
+          for(ptrdiff_t ik = 0; ik < k_end; ++ik)
+            filtered += kernel[ik] * src(i, j_begin + ik);
+
+          for (ptrdiff_t ik = k_end; ik < kernel_sz; ++ik)
+            filtered += kernel[ik] * src(i, ik - k_end);
+
+          dst(i, j) = filtered;
+        }
+    }
+    break;
+    }
+  }
+
+  template<typename T>
+  void filter_y_rows(ConstImageView<T> src, T const* kernel, ptrdiff_t kernel_sz, BorderCondition bc, ImageView<T> dst,
+    ptrdiff_t row_begin, ptrdiff_t row_end)
+  {
+    // Images shorter than the kernel (like the strips of a fused execution at the image
+    // borders) have rows at both borders, every tap follows the border condition.
+    const ptrdiff_t kernel_radius = kernel_sz / 2;
+    if (src.height() < kernel_sz)
+    {
+      for(ptrdiff_t i = row_begin; i < row_end; ++i)
+        for (ptrdiff_t j = 0; j < src.width(); ++j)
+        {
+          T filtered = T(0);
+          for(ptrdiff_t ik = 0; ik < kernel_sz; ++ik)
+          {
+            const auto index = border_index(i - kernel_radius + ik, src.height(), bc);
+            if (index >= 0)
+              filtered += kernel[ik] * src(index, j);
+          }
+
+          dst(i, j) = filtered;
+        }
+      return;
+    }
+
+    // Handle inner pixels (avoiding boundary conditions).
+    const ptrdiff_t inner_begin = std::max(row_begin, kernel_radius);
+    const ptrdiff_t inner_end = std::min(row_end, src.height() - kernel_radius);
+    for(ptrdiff_t i = inner_begin; i < inner_end; ++i)
+      filter_y_inner_row(src.row(i - kernel_radius), src.stride(), kernel, kernel_sz, src.width(), dst.row(i));
+
+    // Handle border pixels.
+    switch (bc)
+    {
+    case BorderCondition::BC_ZERO:
+    {
+      // Top border pixels.
+      for(ptrdiff_t i = row_begin; i < std::min(row_end, kernel_radius); ++i)
+        for (ptrdiff_t j = 0; j < src.width(); ++j)
+        {
+          const auto i_begin = i - kernel_radius;
+          const auto k_begin = -i_begin;
+
+          T filtered = T(0);
+          for(ptrdiff_t ik = k_begin; ik < kernel_sz; ++ik)
+            filtered += kernel[ik] * src(i_begin + ik, j);
+
+          dst(i, j) = filtered;
+        }
+
+      // Bottom border pixels.
+      for(ptrdiff_t i = std::max(row_begin, src.height() - kernel_radius); i < row_end; ++i)
+        for (ptrdiff_t j = 0; j < src.width(); ++j)
+        {
+          const auto i_begin = i - kernel_radius;
+          const auto k_end = src.height() - i_begin;
+
+          T filtered = T(0);
+          for(ptrdiff_t ik = 0; ik < k_end; ++ik)
+            filtered += kernel[ik] * src(i_begin + ik, j);
+
+          dst(i, j) = filtered;
+        }
+    }
+    break;
+    case BorderCondition::BC_CLAMP:
+    {
+      // Top border pixels.
+      for(ptrdiff_t i = row_begin; i < std::min(row_end, kernel_radius); ++i)
+        for (ptrdiff_t j = 0; j < src.width(); ++j)
+        {
+          const auto i_begin = i - kernel_radius;
+          const auto k_begin = -i_begin;
+
+          T filtered = T(0);
+          for(ptrdiff_t ik = k_begin; ik < kernel_sz; ++ik)
+            filtered += kernel[ik] * src(i_begin + ik, j);
+
+          for (ptrdiff_t ik = 0; ik < k_begin; ++ik)
+            filtered += kernel[ik] * src(0, j);
+
+          dst(i, j) = filtered;
+        }
+
+      // Bottom border pixels.
+      for(ptrdiff_t i = std::max(row_begin, src.height() - kernel_radius); i < row_end; ++i)
+        for (ptrdiff_t j = 0; j < src.width(); ++j)
+        {
+          const auto i_begin = i - kernel_radius;
+          const auto k_end = src.height() - i_begin;
+
+          T filtered = T(0);
+          for(ptrdiff_t ik = 0; ik < k_end; ++ik)
+            filtered += kernel[ik] * src(i_begin + ik, j);
+
+          for (ptrdiff_t ik = k_end; ik < kernel_sz; ++ik)
+            filtered += kernel[ik] * src(src.height() - 1, j);
+
+          dst(i, j) = filtered;
+        }
+    }
+    break;
+    case BorderCondition::BC_WRAP:
+    {
+      // Top border pixels.
+      for(ptrdiff_t i = row_begin; i < std::min(row_end, kernel_radius); ++i)
+        for (ptrdiff_t j = 0; j < src.width(); ++j)
+        {
+          const auto i_begin = i - kernel_radius;
+          const auto k_begin = -i_begin;
+
+          T filtered = T(0);
+          for(ptrdiff_t ik = k_begin; ik < kernel_sz; ++ik)
+            filtered += kernel[ik] * src(i_begin + ik, j);
+
+          const auto wrap_begin = src.height() - k_begin;
+          for (ptrdiff_t ik = 0; ik < k_begin; ++ik)
+            filtered += kernel[ik] * src(wrap_begin + ik, j);
+
+          dst(i, j) = filtered;
+        }
+
+      // Bottom border pixels.
+      for(ptrdiff_t i = std::max(row_begin, src.height() - kernel_radius); i < row_end; ++i)
+        for (ptrdiff_t j = 0; j < src.width(); ++j)
+        {
+          const auto i_begin = i - kernel_radius;
+          const auto k_end = src.height() - i_begin;
+
+          T filtered = T(0);
+          for(ptrdiff_t ik = 0; ik < k_end; ++ik)
+            filtered += kernel[ik] * src(i_begin + ik, j);
+
+          for (ptrdiff_t ik = k_end; ik < kernel_sz; ++ik)
+            filtered += kernel[ik] * src(ik - k_end, j);
+
+          dst(i, j) = filtered;
+        }
+    }
+    break;
+    }
+  }
+}
+
+// Separable filtering is computed in independent row bands (see parallel_for_rows),
+// which gives results identical to the serial execution.
+template<typename T>
+void filter_x(ConstImageView<T> src, T const* kernel, ptrdiff_t kernel_sz, BorderCondition bc, ImageView<T> dst)
+{
+  parallel_for_rows(src.height(), src.width(), [&](ptrdiff_t row_begin, ptrdiff_t row_end)
+    {
+      detail::filter_x_rows(src, kernel, kernel_sz, bc, dst, row_begin, row_end);
+    });
+}
+
+template<typename T>
+void filter_x(Image2d<T> const& src, T const* kernel, ptrdiff_t kernel_sz, BorderCondition bc, Image2d<T>& dst)
+{
+  filter_x(src.view(), kernel, kernel_sz, bc, dst.view());
+}
+
+template<typename T>
+void filter_y(ConstImageView<T> src, T const* kernel, ptrdiff_t kernel_sz, BorderCondition bc, ImageView<T> dst)
+{
+  parallel_for_rows(src.height(), src.width(), [&](ptrdiff_t row_begin, ptrdiff_t row_end)
+    {
+      detail::filter_y_rows(src, kernel, kernel_sz, bc, dst, row_begin, row_end);
+    });
+}
+
+template<typename T>
+void filter_y(Image2d<T> const& src, T const* kernel, ptrdiff_t kernel_sz, BorderCondition bc, Image2d<T>& dst)
+{
+  filter_y(src.view(), kernel, kernel_sz, bc, dst.view());
+}
+
+template<typename T>
+void diff_filter_x(ConstImageView<T> src, BorderCondition bc, ImageView<T> dst)
+{
+  T diff_kernel[] = { T(-1), T(0), T(1) };
+  filter_x(src, diff_kernel, 3, bc, dst);
+}
+
+template<typename T>
+void diff_filter_x(Image2d<T> const& src, BorderCondition bc, Image2d<T>& dst)
+{
+  diff_filter_x(src.view(), bc, dst.view());
+}
+
+template<typename T>
+void diff_filter_y(ConstImageView<T> src, BorderCondition bc, ImageView<T> dst)
+{
+  T diff_kernel[] = { T(-1), T(0), T(1) };
+  filter_y(src, diff_kernel, 3, bc, dst);
+}
+
+template<typename T>
+void diff_filter_y(Image2d<T> const& src, BorderCondition bc, Image2d<T>& dst)
+{
+  diff_filter_y(src.view(), bc, dst.view());
+}
+
+template<typename T>
+void sobel_x(ConstImageView<T> src, BorderCondition bc, ImageView<T> dst)
+{
+  ScratchImage<T> tmp(src.height(), src.width());
+
+  T avg_kernel[] = { T(1), T(2), T(1) };
+  filter_y(src, avg_kernel, 3, bc, tmp.view());
+
+  diff_filter_x(tmp.view(), bc, dst);
+}
+
+template<typename T>
+void sobel_x(Image2d<T> const& src, BorderCondition bc, Image2d<T>& dst)
+{
+  sobel_x(src.view(), bc, dst.view());
+}
+
+template<typename T>
+void sobel_y(ConstImageView<T> src, BorderCondition bc, ImageView<T> dst)
+{
+  ScratchImage<T> tmp(src.height(), src.width());
+
+  T avg_kernel[] = { T(1), T(2), T(1) };
+  filter_x(src, avg_kernel, 3, bc, tmp.view());
+
+  diff_filter_y(tmp.view(), bc, dst);
+}
+
+template<typename T>
+void sobel_y(Image2d<T> const& src, BorderCondition bc, Image2d<T>& dst)
+{
+  sobel_y(src.view(), bc, dst.view());
+}
+
+enum class GradientNorm { L2, SquaredL2 };
+
+namespace detail
+{
+  int8_t canny_get_angle_bin(double angle);
+
+  // tan(22.5°) and tan(67.5°), the bin boundaries of the gradient directions.
+  constexpr double tan_eighth_pi = 0.41421356237309503;
+  constexpr double tan_three_eighths_pi = 2.4142135623730950;
+
+  // Direction bin of the gradient as used by the Canny non-max suppression: 0 is
+  // horizontal, 2 vertical, 1 and 3 the diagonals with equal and opposite signs of
+  // gx and gy. Equals canny_get_angle_bin of atan2(gy, gx) without computing the
+  // angle; the comparisons are done in double so that they are exact for float.
+  template<typename T>
+  int8_t gradient_direction_bin(T gx, T gy)
+  {
+    const double ax = std::abs(double(gx));
+    const double ay = std::abs(double(gy));
+    const int8_t diagonal = std::signbit(double(gx)) == std::signbit(double(gy)) ? 1 : 3;
+
+    return ay < tan_eighth_pi * ax ? 0 : (ay >= tan_three_eighths_pi * ax ? 2 : diagonal);
   }
-  break;
-  case BorderCondition::BC_CLAMP:
+
+  template<typename T>
+  void gradient_direction_row(T const* grad_x_row, T const* grad_y_row, ptrdiff_t width, int8_t* dst_row)
+  {
+    for (ptrdiff_t j = 0; j < width; ++j)
+      dst_row[j] = gradient_direction_bin(grad_x_row[j], grad_y_row[j]);
+  }
+
+  // 3x3 Sobel gradients of the inner pixels 1 <= j < width - 1 of a row, given the rows
+  // above and below. The gradient rows are only written if they are not null.
+  template<typename T>
+  void sobel_inner_row(T const* row_up, T const* row_mid, T const* row_down, ptrdiff_t width,
+    bool squared, T* magnitude_row, T* grad_x_row, T* grad_y_row)
   {
-    // Left border pixels.
-    for(ptrdiff_t i = 0; i < src.height(); ++i)
-      for (ptrdiff_t j = 0; j < kernel_radius; ++j)
+    for (ptrdiff_t j = 1; j < width - 1; ++j)
+    {
+      const T gx = ((row_up[j + 1] + T(2) * row_mid[j + 1]) + row_down[j + 1]) -
+        ((row_up[j - 1] + T(2) * row_mid[j - 1]) + row_down[j - 1]);
+      const T gy = ((row_down[j - 1] + T(2) * row_down[j]) + row_down[j + 1]) -
+        ((row_up[j - 1] + T(2) * row_up[j]) + row_up[j + 1]);
+
+      const T sq = gx * gx + gy * gy;
+      magnitude_row[j] = squared ? sq : T(std::sqrt(sq));
+      if (grad_x_row)
       {
-        const auto j_begin = j - kernel_radius;
-        const auto k_begin = -j_begin;
+        grad_x_row[j] = gx;
+        grad_y_row[j] = gy;
+      }
+    }
+  }
 
-        T filtered = T(0);
-        for(ptrdiff_t ik = k_begin; ik < kernel_sz; ++ik)
-          filtered += kernel[ik] * src(i, j_begin + ik);
+  template<typename T>
+  void sobel_gradient_rows(ConstImageView<T> src, BorderCondition bc, GradientNorm norm,
+    ImageView<T> magnitude, ImageView<int8_t> directions, ptrdiff_t row_begin, ptrdiff_t row_end)
+  {
+    const auto h = src.height();
+    const auto w = src.width();
+    if (w == 0)
+      return;
+
+    // Rows outside of a zero-bordered image read from a zero row, the gradient rows
+    // are only needed for the directions.
+    std::vector<T> zero_row(size_t(w), T(0));
+    const bool with_directions = directions.data() != nullptr;
+    std::vector<T> grad_rows(with_directions ? size_t(2 * w) : 0);
+    T* grad_x_row = with_directions ? grad_rows.data() : nullptr;
+    T* grad_y_row = with_directions ? grad_rows.data() + w : nullptr;
+
+    const auto src_row = [&](ptrdiff_t i)
+    {
+      const auto index = border_index(i, h, bc);
+      return index < 0 ? zero_row.data() : src.row(index);
+    };
 
-        for (ptrdiff_t ik = 0; ik < k_begin; ++ik)
-          filtered += kernel[ik] * src(i, 0);
+    for (ptrdiff_t i = row_begin; i < row_end; ++i)
+    {
+      T const* row_up = src_row(i - 1);
+      T const* row_mid = src.row(i);
+      T const* row_down = src_row(i + 1);
+      const auto magnitude_row = magnitude.row(i);
+
+      sobel_inner_row(row_up, row_mid, row_down, w, norm == GradientNorm::SquaredL2, magnitude_row, grad_x_row, grad_y_row);
+
+      // Border columns.
+      const auto pixel = [&](T const* row, ptrdiff_t j)
+      {
+        const auto index = border_index(j, w, bc);
+        return index < 0 ? T(0) : row[index];
+      };
 
-        dst(i, j) = filtered;
+      for (const ptrdiff_t j : { ptrdiff_t(0), w - 1 })
+      {
+        const T gx = ((pixel(row_up, j + 1) + T(2) * pixel(row_mid, j + 1)) + pixel(row_down, j + 1)) -
+          ((pixel(row_up, j - 1) + T(2) * pixel(row_mid, j - 1)) + pixel(row_down, j - 1));
+        const T gy = ((pixel(row_down, j - 1) + T(2) * pixel(row_down, j)) + pixel(row_down, j + 1)) -
+          ((pixel(row_up, j - 1) + T(2) * pixel(row_up, j)) + pixel(row_up, j + 1));
+
+        const T sq = gx * gx + gy * gy;
+        magnitude_row[j] = norm == GradientNorm::L2 ? T(std::sqrt(sq)) : sq;
+        if (grad_x_row)
+        {
+          grad_x_row[j] = gx;
+          grad_y_row[j] = gy;
+        }
       }
 
-    // Right border pixels.
-    for(ptrdiff_t i = 0; i < src.height(); ++i)
-      for (ptrdiff_t j = src.width() - kernel_radius; j < src.width(); ++j)
+      if (with_directions)
       {
-        const auto j_begin = j - kernel_radius;
-        const auto k_end = src.width() - j_begin;
+        gradient_direction_row(grad_x_row, grad_y_row, w, directions.row(i));
+      }
+    }
+  }
+}
+
+// Fused 3x3 Sobel operator: reads the source once and writes the gradient magnitude
+// (or its square) and, if directions is not empty, the quantized gradient direction bins.
+template<typename T>
+void sobel_gradient(ConstImageView<T> src, BorderCondition bc, GradientNorm norm, ImageView<T> magnitude,
+  ImageView<int8_t> directions = ImageView<int8_t>())
+{
+  parallel_for_rows(src.height(), src.width(), [&](ptrdiff_t row_begin, ptrdiff_t row_end)
+    {
+      detail::sobel_gradient_rows(src, bc, norm, magnitude, directions, row_begin, row_end);
+    });
+}
+
+template<typename T>
+void sobel_gradient(Image2d<T> const& src, BorderCondition bc, GradientNorm norm, Image2d<T>& magnitude)
+{
+  sobel_gradient(src.view(), bc, norm, magnitude.view());
+}
+
+template<typename T>
+void sobel_gradient(Image2d<T> const& src, BorderCondition bc, GradientNorm norm, Image2d<T>& magnitude,
+  Image2d<int8_t>& directions)
+{
+  sobel_gradient(src.view(), bc, norm, magnitude.view(), directions.view());
+}
 
-        T filtered = T(0);
-        for(ptrdiff_t ik = 0; ik < k_end; ++ik)
-          filtered += kernel[ik] * src(i, j_begin + ik);
+template<typename T>
+void sobel_abs(ConstImageView<T> src, BorderCondition bc, ImageView<T> dst)
+{
+  sobel_gradient(src, bc, GradientNorm::L2, dst);
+}
 
-        for (ptrdiff_t ik = k_end; ik < kernel_sz; ++ik)
-          filtered += kernel[ik] * src(i, src.width() - 1);
+template<typename T>
+void sobel_abs(Image2d<T> const& src, BorderCondition bc, Image2d<T>& dst)
+{
+  sobel_abs(src.view(), bc, dst.view());
+}
 
-        dst(i, j) = filtered;
+namespace detail
+{
+  // Running sums of float images are accumulated in double to limit the drift.
+  template<typename T>
+  using box_accumulator_t = std::conditional_t<std::is_floating_point_v<T>, double, T>;
+
+  template<typename T>
+  void box_filter_x_rows(ConstImageView<T> src, ptrdiff_t kernel_radius, BorderCondition bc, ImageView<T> dst,
+    ptrdiff_t row_begin, ptrdiff_t row_end)
+  {
+    using Acc = box_accumulator_t<T>;
+
+    const auto w = src.width();
+    if (w == 0)
+      return;
+
+    const auto sample = [w, bc](T const* row, ptrdiff_t k)
+    {
+      if (k >= 0 && k < w)
+        return Acc(row[k]);
+
+      const auto index = border_index(k, w, bc);
+      return index < 0 ? Acc(0) : Acc(row[index]);
+    };
+
+    for (ptrdiff_t i = row_begin; i < row_end; ++i)
+    {
+      const auto src_row = src.row(i);
+      const auto dst_row = dst.row(i);
+
+      Acc filtered = Acc(0);
+      for (ptrdiff_t k = -kernel_radius; k <= kernel_radius; ++k)
+        filtered += sample(src_row, k);
+
+      dst_row[0] = T(filtered);
+
+      // Slide the window: add the entering and subtract the leaving sample.
+      for (ptrdiff_t j = 1; j < w; ++j)
+      {
+        filtered += sample(src_row, j + kernel_radius) - sample(src_row, j - kernel_radius - 1);
+        dst_row[j] = T(filtered);
       }
+    }
   }
-  break;
-  case BorderCondition::BC_WRAP:
+
+  template<typename T>
+  void box_filter_y_rows(ConstImageView<T> src, ptrdiff_t kernel_radius, BorderCondition bc, ImageView<T> dst,
+    ptrdiff_t row_begin, ptrdiff_t row_end)
   {
-    // Left border pixels.
-    for(ptrdiff_t i = 0; i < src.height(); ++i)
-      for (ptrdiff_t j = 0; j < kernel_radius; ++j)
+    using Acc = box_accumulator_t<T>;
+
+    const auto h = src.height();
+    const auto w = src.width();
+
+    // Source row at position k, or nullptr for a row of zeros.
+    const auto sample_row = [&src, h, bc](ptrdiff_t k) -> T const*
+    {
+      const auto index = (k >= 0 && k < h) ? k : border_index(k, h, bc);
+      return index < 0 ? nullptr : src.row(index);
+    };
+
+    // Column sums of the window around the current row.
+    std::vector<Acc> filtered(w, Acc(0));
+    for (ptrdiff_t k = row_begin - kernel_radius; k <= row_begin + kernel_radius; ++k)
+    {
+      if (const auto row = sample_row(k))
+        for (ptrdiff_t j = 0; j < w; ++j)
+          filtered[j] += Acc(row[j]);
+    }
+
+    for (ptrdiff_t i = row_begin; i < row_end; ++i)
+    {
+      if (i > row_begin)
       {
-        const auto j_begin = j - kernel_radius;
-        const auto k_begin = -j_begin;
+        if (const auto entering = sample_row(i + kernel_radius))
+          for (ptrdiff_t j = 0; j < w; ++j)
+            filtered[j] += Acc(entering[j]);
+
+        if (const auto leaving = sample_row(i - kernel_radius - 1))
+          for (ptrdiff_t j = 0; j < w; ++j)
+            filtered[j] -= Acc(leaving[j]);
+      }
+
+      const auto dst_row = dst.row(i);
+      for (ptrdiff_t j = 0; j < w; ++j)
+        dst_row[j] = T(filtered[j]);
+    }
+  }
+}
+
+// Box filters use running sums, so their cost per pixel does not depend on the radius.
+template<typename T>
+void box_filter_x(ConstImageView<T> src, ptrdiff_t kernel_radius, BorderCondition bc, ImageView<T> dst)
+{
+  parallel_for_rows(src.height(), src.width(), [&](ptrdiff_t row_begin, ptrdiff_t row_end)
+    {
+      detail::box_filter_x_rows(src, kernel_radius, bc, dst, row_begin, row_end);
+    });
+}
+
+template<typename T>
+void box_filter_x(Image2d<T> const& src, ptrdiff_t kernel_radius, BorderCondition bc, Image2d<T>& dst)
+{
+  box_filter_x(src.view(), kernel_radius, bc, dst.view());
+}
+
+template<typename T>
+void box_filter_y(ConstImageView<T> src, ptrdiff_t kernel_radius, BorderCondition bc, ImageView<T> dst)
+{
+  // Every band starts its own running sum.
+  parallel_for_rows(src.height(), src.width(), [&](ptrdiff_t row_begin, ptrdiff_t row_end)
+    {
+      detail::box_filter_y_rows(src, kernel_radius, bc, dst, row_begin, row_end);
+    });
+}
+
+template<typename T>
+void box_filter_y(Image2d<T> const& src, ptrdiff_t kernel_radius, BorderCondition bc, Image2d<T>& dst)
+{
+  box_filter_y(src.view(), kernel_radius, bc, dst.view());
+}
+
+template<typename T>
+void box_filter(ConstImageView<T> src, ptrdiff_t kernel_radius_y, ptrdiff_t kernel_radius_x, BorderCondition bc, ImageView<T> dst)
+{
+  ScratchImage<T> tmp(src.height(), src.width());
+  box_filter_x(src, kernel_radius_x, bc, tmp.view());
+  box_filter_y(tmp.view(), kernel_radius_y, bc, dst);
+}
+
+template<typename T>
+void box_filter(Image2d<T> const& src, ptrdiff_t kernel_radius_y, ptrdiff_t kernel_radius_x, BorderCondition bc, Image2d<T>& dst)
+{
+  box_filter(src.view(), kernel_radius_y, kernel_radius_x, bc, dst.view());
+}
+
+// Size of an image downscaled by the given factor, partial blocks at the right and
+// bottom borders give a pixel of their own.
+inline Position downscaled_size(Position const& sz, ptrdiff_t factor)
+{
+  return Position((sz.y + factor - 1) / factor, (sz.x + factor - 1) / factor);
+}
+
+// Averages every factor x factor block of src into a pixel of dst, which needs the
+// size downscaled_size(src.size(), factor). Used for quick previews of large images.
+template<typename T>
+void downscale_box(ConstImageView<T> src, ptrdiff_t factor, ImageView<T> dst)
+{
+  parallel_for_rows(dst.height(), src.width() * factor, [&](ptrdiff_t row_begin, ptrdiff_t row_end)
+    {
+      std::vector<float> sums(static_cast<size_t>(dst.width()));
+      for (ptrdiff_t y = row_begin; y < row_end; ++y)
+      {
+        std::fill(sums.begin(), sums.end(), 0.f);
+
+        const auto src_y_end = std::min(src.height(), (y + 1) * factor);
+        for (ptrdiff_t src_y = y * factor; src_y < src_y_end; ++src_y)
+        {
+          const auto src_row = src.row(src_y);
+          for (ptrdiff_t x = 0; x < dst.width(); ++x)
+          {
+            const auto src_x_end = std::min(src.width(), (x + 1) * factor);
+            for (ptrdiff_t src_x = x * factor; src_x < src_x_end; ++src_x)
+              sums[size_t(x)] += float(src_row[src_x]);
+          }
+        }
+
+        const auto block_h = src_y_end - y * factor;
+        const auto dst_row = dst.row(y);
+        for (ptrdiff_t x = 0; x < dst.width(); ++x)
+        {
+          const auto block_w = std::min(src.width(), (x + 1) * factor) - x * factor;
+          dst_row[x] = detail::convert_pixel<T>(sums[size_t(x)] / float(block_h * block_w));
+        }
+      }
+    });
+}
+
+template<typename T>
+void downscale_box(Image2d<T> const& src, ptrdiff_t factor, Image2d<T>& dst)
+{
+  const auto dst_size = downscaled_size(src.size(), factor);
+  if (dst.height() != dst_size.y || dst.width() != dst_size.x)
+    dst.allocUninitialized(dst_size);
+
+  downscale_box<T>(src.view(), factor, dst.view());
+}
+
+namespace detail
+{
+  template<typename T>
+  void create_gauss_kernel(ptrdiff_t kernel_radius, T sigma, Image2d<T>& dst)
+  {
+    const auto kernel_sz = 2 * kernel_radius + 1;
+    const auto factor = T(0.5) / (sigma * sigma);
+    dst.allocUninitialized(1, kernel_sz);
+    foreach_x(dst, x)
+    {
+      const auto dx = x - kernel_radius;
+      dst(0, x) = exp(-factor * T(dx * dx));
+    }
+
+    // Normalize the kernel.
+    const auto normalization = T(1) / sum(dst);
+    mul(dst, normalization, dst);
+  }
+}
+
+template<typename T>
+void gauss_filter_x(ConstImageView<T> src, ptrdiff_t kernel_radius, detail::type_identity_t<T> sigma, BorderCondition bc, ImageView<T> dst)
+{
+  static_assert(std::is_floating_point_v<T>, "Gauss filter only supports floating point images.");
+
+  Image2d<T> gauss_kernel;
+  detail::create_gauss_kernel(kernel_radius, sigma, gauss_kernel);
+
+  filter_x(src, gauss_kernel.data(), gauss_kernel.width(), bc, dst);
+}
+
+template<typename T>
+void gauss_filter_x(Image2d<T> const& src, ptrdiff_t kernel_radius, T sigma, BorderCondition bc, Image2d<T>& dst)
+{
+  gauss_filter_x(src.view(), kernel_radius, sigma, bc, dst.view());
+}
+
+template<typename T>
+void gauss_filter_y(ConstImageView<T> src, ptrdiff_t kernel_radius, detail::type_identity_t<T> sigma, BorderCondition bc, ImageView<T> dst)
+{
+  static_assert(std::is_floating_point_v<T>, "Gauss filter only supports floating point images.");
+
+  Image2d<T> gauss_kernel;
+  detail::create_gauss_kernel(kernel_radius, sigma, gauss_kernel);
+
+  filter_y(src, gauss_kernel.data(), gauss_kernel.width(), bc, dst);
+}
+
+template<typename T>
+void gauss_filter_y(Image2d<T> const& src, ptrdiff_t kernel_radius, T sigma, BorderCondition bc, Image2d<T>& dst)
+{
+  gauss_filter_y(src.view(), kernel_radius, sigma, bc, dst.view());
+}
+
+template<typename T>
+void gauss_filter(ConstImageView<T> src, ptrdiff_t kernel_radius_y, ptrdiff_t kernel_radius_x, 
+  detail::type_identity_t<T> sigma_y, detail::type_identity_t<T> sigma_x, BorderCondition bc, ImageView<T> dst)
+{
+  ScratchImage<T> tmp(src.height(), src.width());
+  gauss_filter_x(src, kernel_radius_x, sigma_x, bc, tmp.view());
+  gauss_filter_y(tmp.view(), kernel_radius_y, sigma_y, bc, dst);
+}
+
+template<typename T>
+void gauss_filter(Image2d<T> const& src, ptrdiff_t kernel_radius_y, ptrdiff_t kernel_radius_x, T sigma_y, T sigma_x, BorderCondition bc, Image2d<T>& dst)
+{
+  gauss_filter(src.view(), kernel_radius_y, kernel_radius_x, sigma_y, sigma_x, bc, dst.view());
+}
+
+namespace detail
+{
+  // Coefficients of the third order recursive Gaussian of Young and van Vliet:
+  // w[n] = gain * x[n] + a[0] * w[n-1] + a[1] * w[n-2] + a[2] * w[n-3], run forward
+  // and then backward. right_border is the matrix of Triggs and Sdika that yields the
+  // backward states at the end of the signal for a clamped (constant) continuation.
+  struct RecursiveGaussCoefficients
+  {
+    double gain;
+    double a[3];
+    double right_border[3][3];
+  };
+
+  RecursiveGaussCoefficients recursive_gauss_coefficients(double sigma);
+
+  // Initial backward states y[n-1], y[n], y[n+1] from the last forward states
+  // w[n-1], w[n-2], w[n-3] and the last input value.
+  inline void recursive_gauss_right_border(RecursiveGaussCoefficients const& c,
+    double w1, double w2, double w3, double last, double& y1, double& y2, double& y3)
+  {
+    const double u[3] = { w1 - last, w2 - last, w3 - last };
+    double v[3];
+    for (int i = 0; i < 3; ++i)
+      v[i] = c.gain * (c.right_border[i][0] * u[0] + c.right_border[i][1] * u[1] + c.right_border[i][2] * u[2]) + last;
+
+    y1 = v[0];
+    y2 = v[1];
+    y3 = v[2];
+  }
+
+  template<typename T>
+  void recursive_gauss_x_rows(ConstImageView<T> src, RecursiveGaussCoefficients const& c, ImageView<T> dst,
+    ptrdiff_t row_begin, ptrdiff_t row_end)
+  {
+    const auto w = src.width();
+    if (w == 0)
+      return;
+
+    for (ptrdiff_t i = row_begin; i < row_end; ++i)
+    {
+      const auto src_row = src.row(i);
+      const auto dst_row = dst.row(i);
+
+      // Forward pass, the signal continues with src_row[0] on the left.
+      double w1 = src_row[0], w2 = w1, w3 = w1;
+      for (ptrdiff_t j = 0; j < w; ++j)
+      {
+        const double w0 = c.gain * double(src_row[j]) + c.a[0] * w1 + c.a[1] * w2 + c.a[2] * w3;
+        dst_row[j] = T(w0);
+        w3 = w2;
+        w2 = w1;
+        w1 = w0;
+      }
+
+      // Backward pass, starting from the exact states of the clamped continuation.
+      double y1, y2, y3;
+      recursive_gauss_right_border(c, w1, w2, w3, double(src_row[w - 1]), y1, y2, y3);
+      dst_row[w - 1] = T(y1);
+      for (ptrdiff_t j = w - 2; j >= 0; --j)
+      {
+        const double y0 = c.gain * double(dst_row[j]) + c.a[0] * y1 + c.a[1] * y2 + c.a[2] * y3;
+        dst_row[j] = T(y0);
+        y3 = y2;
+        y2 = y1;
+        y1 = y0;
+      }
+    }
+  }
+
+  // Runs the recursion down the columns [col_begin, col_end) a whole row segment at a
+  // time, so that the memory is accessed row-wise and the inner loops vectorize.
+  template<typename T>
+  void recursive_gauss_y_cols(ConstImageView<T> src, RecursiveGaussCoefficients const& c, ImageView<T> dst,
+    ptrdiff_t col_begin, ptrdiff_t col_end)
+  {
+    constexpr ptrdiff_t chunk_cols = 256;
+
+    const auto h = src.height();
+    if (h == 0)
+      return;
+
+    std::vector<double> states(4 * chunk_cols);
+    for (ptrdiff_t x0 = col_begin; x0 < col_end; x0 += chunk_cols)
+    {
+      const auto n = std::min(chunk_cols, col_end - x0);
+      double* s0 = states.data();
+      double* s1 = s0 + chunk_cols;
+      double* s2 = s1 + chunk_cols;
+      double* s3 = s2 + chunk_cols;
+
+      // Forward pass, the image continues with its first row at the top.
+      const auto first_row = src.row(0) + x0;
+      for (ptrdiff_t j = 0; j < n; ++j)
+        s1[j] = s2[j] = s3[j] = double(first_row[j]);
+
+      for (ptrdiff_t i = 0; i < h; ++i)
+      {
+        const auto src_row = src.row(i) + x0;
+        const auto dst_row = dst.row(i) + x0;
+        for (ptrdiff_t j = 0; j < n; ++j)
+        {
+          s0[j] = c.gain * double(src_row[j]) + c.a[0] * s1[j] + c.a[1] * s2[j] + c.a[2] * s3[j];
+          dst_row[j] = T(s0[j]);
+        }
+
+        std::swap(s3, s0);
+        std::swap(s3, s2);
+        std::swap(s2, s1);
+      }
+
+      // Backward pass, starting from the exact states of the clamped continuation.
+      const auto last_row = src.row(h - 1) + x0;
+      for (ptrdiff_t j = 0; j < n; ++j)
+        recursive_gauss_right_border(c, s1[j], s2[j], s3[j], double(last_row[j]), s1[j], s2[j], s3[j]);
+
+      const auto dst_last_row = dst.row(h - 1) + x0;
+      for (ptrdiff_t j = 0; j < n; ++j)
+        dst_last_row[j] = T(s1[j]);
+
+      for (ptrdiff_t i = h - 2; i >= 0; --i)
+      {
+        const auto dst_row = dst.row(i) + x0;
+        for (ptrdiff_t j = 0; j < n; ++j)
+        {
+          s0[j] = c.gain * double(dst_row[j]) + c.a[0] * s1[j] + c.a[1] * s2[j] + c.a[2] * s3[j];
+          dst_row[j] = T(s0[j]);
+        }
+
+        std::swap(s3, s0);
+        std::swap(s3, s2);
+        std::swap(s2, s1);
+      }
+    }
+  }
+}
+
+// Recursive (IIR) approximation of the Gauss filter, its cost does not depend on sigma.
+// Borders are clamped, sigmas below 0.5 are treated as 0.5. The result deviates from the FIR
+// filter by about one percent of the image range, see the tests.
+template<typename T>
+void gauss_filter_iir_x(ConstImageView<T> src, detail::type_identity_t<T> sigma, ImageView<T> dst)
+{
+  static_assert(std::is_floating_point_v<T>, "Gauss filter only supports floating point images.");
+
+  const auto coefficients = detail::recursive_gauss_coefficients(double(sigma));
+  parallel_for_rows(src.height(), src.width(), [&](ptrdiff_t row_begin, ptrdiff_t row_end)
+    {
+      detail::recursive_gauss_x_rows(src, coefficients, dst, row_begin, row_end);
+    });
+}
+
+template<typename T>
+void gauss_filter_iir_x(Image2d<T> const& src, T sigma, Image2d<T>& dst)
+{
+  gauss_filter_iir_x(src.view(), sigma, dst.view());
+}
+
+template<typename T>
+void gauss_filter_iir_y(ConstImageView<T> src, detail::type_identity_t<T> sigma, ImageView<T> dst)
+{
+  static_assert(std::is_floating_point_v<T>, "Gauss filter only supports floating point images.");
+
+  // The columns are independent, so the image is split into column bands.
+  const auto coefficients = detail::recursive_gauss_coefficients(double(sigma));
+  const auto min_band_cols = std::max<ptrdiff_t>(64, detail::min_band_pixels / std::max<ptrdiff_t>(src.height(), 1));
+  parallel_for(0, src.width(), min_band_cols, [&](ptrdiff_t col_begin, ptrdiff_t col_end)
+    {
+      detail::recursive_gauss_y_cols(src, coefficients, dst, col_begin, col_end);
+    });
+}
+
+template<typename T>
+void gauss_filter_iir_y(Image2d<T> const& src, T sigma, Image2d<T>& dst)
+{
+  gauss_filter_iir_y(src.view(), sigma, dst.view());
+}
+
+template<typename T>
+void gauss_filter_iir(ConstImageView<T> src, detail::type_identity_t<T> sigma_y, detail::type_identity_t<T> sigma_x, ImageView<T> dst)
+{
+  ScratchImage<T> tmp(src.height(), src.width());
+  gauss_filter_iir_x(src, sigma_x, tmp.view());
+  gauss_filter_iir_y(tmp.view(), sigma_y, dst);
+}
+
+template<typename T>
+void gauss_filter_iir(Image2d<T> const& src, T sigma_y, T sigma_x, Image2d<T>& dst)
+{
+  gauss_filter_iir(src.view(), sigma_y, sigma_x, dst.view());
+}
+
+// Size of the next coarser pyramid level, odd sizes round up.
+inline Position pyr_down_size(Position const& sz)
+{
+  return Position((sz.y + 1) / 2, (sz.x + 1) / 2);
+}
+
+// Blurs src with the 5-tap Gauss kernel of sigma 1 and keeps every second row and
+// column, dst needs the size pyr_down_size(src.size()). Borders are clamped. The blur
+// is only evaluated at the kept pixels: every band of dst rows filters the source
+// rows in y into a single row buffer, which is then filtered in x at the even columns.
+template<typename T>
+void pyr_down(ConstImageView<T> src, ImageView<T> dst)
+{
+  static_assert(std::is_floating_point_v<T>, "Pyramids only support floating point images.");
+
+  constexpr ptrdiff_t radius = 2;
+  Image2d<T> gauss_kernel;
+  detail::create_gauss_kernel(radius, T(1), gauss_kernel);
+  const auto kernel = gauss_kernel.row(0);
+
+  parallel_for_rows(dst.height(), 2 * src.width(), [&](ptrdiff_t row_begin, ptrdiff_t row_end)
+    {
+      // Padded by the clamped border pixels on both sides.
+      std::vector<T> blurred(static_cast<size_t>(src.width() + 2 * radius));
+      const auto blurred_row = blurred.data() + radius;
+      for (ptrdiff_t y = row_begin; y < row_end; ++y)
+      {
+        T const* src_rows[2 * radius + 1];
+        for (ptrdiff_t i = 0; i <= 2 * radius; ++i)
+          src_rows[i] = src.row(std::clamp<ptrdiff_t>(2 * y + i - radius, 0, src.height() - 1));
+
+        for (ptrdiff_t x = 0; x < src.width(); ++x)
+        {
+          blurred_row[x] = kernel[0] * src_rows[0][x] + kernel[1] * src_rows[1][x] + kernel[2] * src_rows[2][x] +
+            kernel[3] * src_rows[3][x] + kernel[4] * src_rows[4][x];
+        }
+
+        for (ptrdiff_t i = 1; i <= radius; ++i)
+        {
+          blurred_row[-i] = blurred_row[0];
+          blurred_row[src.width() - 1 + i] = blurred_row[src.width() - 1];
+        }
+
+        const auto dst_row = dst.row(y);
+        for (ptrdiff_t x = 0; x < dst.width(); ++x)
+        {
+          const auto center = blurred_row + 2 * x;
+          dst_row[x] = kernel[0] * center[-2] + kernel[1] * center[-1] + kernel[2] * center[0] +
+            kernel[3] * center[1] + kernel[4] * center[2];
+        }
+      }
+    });
+}
+
+template<typename T>
+void pyr_down(Image2d<T> const& src, Image2d<T>& dst)
+{
+  const auto dst_size = pyr_down_size(src.size());
+  if (dst.height() != dst_size.y || dst.width() != dst_size.x)
+    dst.allocUninitialized(dst_size);
+
+  pyr_down<T>(src.view(), dst.view());
+}
+
+// Gaussian pyramid: level 0 is the source image, every further level is the previous
+// one reduced by pyr_down. The source is not copied, so it needs to outlive the pyramid.
+class GaussPyramid
+{
+public:
+  GaussPyramid() = default;
+  explicit GaussPyramid(ConstImageView<float> src, size_t n_levels);
+
+  // Builds up to n_levels levels, stopping early at a 1 x 1 level. The level images 
+  // are reused when rebuilding for a source of the same size.
+  void build(ConstImageView<float> src, size_t n_levels);
+
+  size_t levels() const;
+  ConstImageView<float> level(size_t i) const;
+
+private:
+  ConstImageView<float> src_;
+  std::vector<Image2d<float>> levels_;
+};
+
+template<typename T, typename U>
+void threshold_image(ConstImageView<T> src, T threshold, detail::type_identity_t<U> true_val, detail::type_identity_t<U> false_val, ImageView<U> dst)
+{
+  foreach2d(src, y, x)
+  {
+    dst(y, x) = src(y, x) >= threshold ? true_val : false_val;
+  }
+}
+
+template<typename T, typename U>
+void threshold_image(Image2d<T> const& src, T threshold, U true_val, U false_val, Image2d<U>& dst)
+{
+  threshold_image(src.view(), threshold, true_val, false_val, dst.view());
+}
+
+namespace detail
+{
+  template<typename T>
+  struct integral_accumulator
+  {
+    using type = std::conditional_t<std::is_floating_point_v<T>, double,
+      std::conditional_t<std::is_signed_v<T>, int64_t, uint64_t>>;
+  };
+}
+
+// Accumulator type of the summed-area table of a T image, wide enough to not overflow.
+template<typename T>
+using integral_t = typename detail::integral_accumulator<T>::type;
+
+// Builds the summed-area table of src into dst, which needs to be one row and one 
+// column larger than src: dst(y, x) is the sum of src over the rows [0, y) and the 
+// columns [0, x), so the first row and column are zero. The rows are prefix-summed 
+// in parallel, followed by the column prefix sums over parallel column bands.
+template<typename T, typename Acc>
+void integral_image(ImageView<T const> src, ImageView<Acc> dst)
+{
+  const auto h = src.height();
+  const auto w = src.width();
 
-        T filtered = T(0);
-        for(ptrdiff_t ik = k_begin; ik < kernel_sz; ++ik)
-          filtered += kernel[ik] * src(i, j_begin + ik);
+  foreach_x(dst, x)
+    dst(0, x) = Acc(0);
 
-        const auto wrap_begin = src.width() - k_begin;
-        for (ptrdiff_t ik = 0; ik < k_begin; ++ik)
-          filtered += kernel[ik] * src(i, wrap_begin + ik);
+  // Row prefix sums.
+  parallel_for_rows(h, w, [&](ptrdiff_t row_begin, ptrdiff_t row_end)
+    {
+      for (ptrdiff_t i = row_begin; i < row_end; ++i)
+      {
+        const auto src_row = src.row(i);
+        const auto dst_row = dst.row(i + 1);
 
-        dst(i, j) = filtered;
+        Acc row_sum = Acc(0);
+        dst_row[0] = row_sum;
+        for (ptrdiff_t j = 0; j < w; ++j)
+        {
+          row_sum += Acc(src_row[j]);
+          dst_row[j + 1] = row_sum;
+        }
       }
+    });
 
-    // Right border pixels.
-    for(ptrdiff_t i = 0; i < src.height(); ++i)
-      for (ptrdiff_t j = src.width() - kernel_radius; j < src.width(); ++j)
+  // Column prefix sums, each band walks down all the rows of its columns.
+  const auto min_band_cols = std::max<ptrdiff_t>(64, detail::min_band_pixels / std::max<ptrdiff_t>(h, 1));
+  parallel_for(1, w + 1, min_band_cols, [&](ptrdiff_t col_begin, ptrdiff_t col_end)
+    {
+      for (ptrdiff_t i = 2; i <= h; ++i)
       {
-        const auto j_begin = j - kernel_radius;
-        const auto k_end = src.width() - j_begin;
+        const auto prev_row = dst.row(i - 1);
+        const auto dst_row = dst.row(i);
+        for (ptrdiff_t j = col_begin; j < col_end; ++j)
+          dst_row[j] += prev_row[j];
+      }
+    });
+}
 
-        T filtered = T(0);
-        for(ptrdiff_t ik = 0; ik < k_end; ++ik)
-          filtered += kernel[ik] * src(i, j_begin + ik);
+template<typename T, typename Acc>
+void integral_image(Image2d<T> const& src, Image2d<Acc>& dst)
+{
+  dst.allocUninitialized(src.height() + 1, src.width() + 1);
+  integral_image(src.view(), dst.view());
+}
 
-        for (ptrdiff_t ik = k_end; ik < kernel_sz; ++ik)
-          filtered += kernel[ik] * src(i, ik - k_end);
+// Sum of the h x w source rectangle with the top left corner at (y, x), in O(1).
+template<typename Acc>
+Acc rect_sum(ImageView<Acc const> table, ptrdiff_t y, ptrdiff_t x, ptrdiff_t h, ptrdiff_t w)
+{
+  return table(y + h, x + w) - table(y, x + w) - table(y + h, x) + table(y, x);
+}
 
-        dst(i, j) = filtered;
-      }
-  }
-  break;
-  }
+template<typename Acc>
+Acc rect_sum(Image2d<Acc> const& table, ptrdiff_t y, ptrdiff_t x, ptrdiff_t h, ptrdiff_t w)
+{
+  return rect_sum(table.view(), y, x, h, w);
 }
 
+// Summed-area table of an image together with the rectangle queries built on it.
 template<typename T>
-void filter_y(Image2d<T> const& src, T const* kernel, ptrdiff_t kernel_sz, BorderCondition bc, Image2d<T>& dst)
+class IntegralImage
 {
-  const ptrdiff_t kernel_radius = kernel_sz / 2;
-  for(ptrdiff_t i = kernel_radius; i < src.height() - kernel_radius; ++i)
-    for (ptrdiff_t j = 0; j < src.width(); ++j)
-    {
-      const ptrdiff_t i_begin = i - kernel_radius;
-      T filtered = T(0);
-      for(ptrdiff_t ik = 0; ik < kernel_sz; ++ik)
-        filtered += kernel[ik] * src(i_begin + ik, j);
+public:
+  using value_type = integral_t<T>;
 
-      dst(i, j) = filtered;
-    }
+  IntegralImage() = default;
+  explicit IntegralImage(Image2d<T> const& src) { build(src.view()); }
+  explicit IntegralImage(ImageView<T const> src) { build(src); }
 
-  // Handle border pixels.
-  switch (bc)
+  void build(ImageView<T const> src)
   {
-  case BorderCondition::BC_ZERO:
+    table_.allocUninitialized(src.height() + 1, src.width() + 1);
+    integral_image(src, table_.view());
+  }
+
+  // Size of the source image.
+  ptrdiff_t width() const { return table_.width() - 1; }
+  ptrdiff_t height() const { return table_.height() - 1; }
+
+  value_type sum(ptrdiff_t y, ptrdiff_t x, ptrdiff_t h, ptrdiff_t w) const
   {
-    // Top border pixels.
-    for(ptrdiff_t i = 0; i < kernel_radius; ++i)
-      for (ptrdiff_t j = 0; j < src.width(); ++j)
-      {
-        const auto i_begin = i - kernel_radius;
-        const auto k_begin = -i_begin;
+    return rect_sum(table_.view(), y, x, h, w);
+  }
 
-        T filtered = T(0);
-        for(ptrdiff_t ik = k_begin; ik < kernel_sz; ++ik)
-          filtered += kernel[ik] * src(i_begin + ik, j);
+  value_type sum(Position const& pos, Position const& sz) const
+  {
+    return sum(pos.y, pos.x, sz.y, sz.x);
+  }
 
-        dst(i, j) = filtered;
-      }
+  double mean(ptrdiff_t y, ptrdiff_t x, ptrdiff_t h, ptrdiff_t w) const
+  {
+    return double(sum(y, x, h, w)) / double(h * w);
+  }
 
-    // Bottom border pixels.
-    for(ptrdiff_t i = src.height() - kernel_radius; i < src.height(); ++i)
-      for (ptrdiff_t j = 0; j < src.width(); ++j)
-      {
-        const auto i_begin = i - kernel_radius;
-        const auto k_end = src.height() - i_begin;
+  Image2d<value_type> const& table() const { return table_; }
 
-        T filtered = T(0);
-        for(ptrdiff_t ik = 0; ik < k_end; ++ik)
-          filtered += kernel[ik] * src(i_begin + ik, j);
+private:
+  Image2d<value_type> table_;
+};
 
-        dst(i, j) = filtered;
-      }
-  }
-  break;
-  case BorderCondition::BC_CLAMP:
+namespace detail
+{
+  struct MinOp
   {
-    // Top border pixels.
-    for(ptrdiff_t i = 0; i < kernel_radius; ++i)
-      for (ptrdiff_t j = 0; j < src.width(); ++j)
-      {
-        const auto i_begin = i - kernel_radius;
-        const auto k_begin = -i_begin;
+    template<typename T>
+    T operator()(T a, T b) const { return b < a ? b : a; }
+  };
 
-        T filtered = T(0);
-        for(ptrdiff_t ik = k_begin; ik < kernel_sz; ++ik)
-          filtered += kernel[ik] * src(i_begin + ik, j);
+  struct MaxOp
+  {
+    template<typename T>
+    T operator()(T a, T b) const { return a < b ? b : a; }
+  };
+
+  // Van Herk/Gil-Werman: the extended line is split into blocks of the window size k,
+  // every window covers the end of one block and the start of the next, so its extremum
+  // combines a suffix extremum of the first with a prefix extremum of the second block.
+  // This takes three comparisons per pixel whatever the radius.
+  template<typename T, typename Op>
+  void morph_x_rows(ConstImageView<T> src, ptrdiff_t kernel_radius, BorderCondition bc, Op op, ImageView<T> dst,
+    ptrdiff_t row_begin, ptrdiff_t row_end)
+  {
+    const auto w = src.width();
+    const auto kernel_sz = 2 * kernel_radius + 1;
+    const auto n = w + 2 * kernel_radius;
 
-        for (ptrdiff_t ik = 0; ik < k_begin; ++ik)
-          filtered += kernel[ik] * src(0, j);
+    std::vector<T> line(static_cast<size_t>(n));
+    std::vector<T> suffix(static_cast<size_t>(n));
+    for (ptrdiff_t i = row_begin; i < row_end; ++i)
+    {
+      const auto src_row = src.row(i);
+      const auto dst_row = dst.row(i);
 
-        dst(i, j) = filtered;
+      for (ptrdiff_t k = 0; k < n; ++k)
+      {
+        const auto index = (k >= kernel_radius && k < w + kernel_radius) ? k - kernel_radius : border_index(k - kernel_radius, w, bc);
+        line[k] = index < 0 ? T(0) : src_row[index];
       }
 
-    // Bottom border pixels.
-    for(ptrdiff_t i = src.height() - kernel_radius; i < src.height(); ++i)
-      for (ptrdiff_t j = 0; j < src.width(); ++j)
+      for (ptrdiff_t block = 0; block < n; block += kernel_sz)
       {
-        const auto i_begin = i - kernel_radius;
-        const auto k_end = src.height() - i_begin;
-
-        T filtered = T(0);
-        for(ptrdiff_t ik = 0; ik < k_end; ++ik)
-          filtered += kernel[ik] * src(i_begin + ik, j);
-
-        for (ptrdiff_t ik = k_end; ik < kernel_sz; ++ik)
-          filtered += kernel[ik] * src(src.height() - 1, j);
+        const auto block_end = std::min(block + kernel_sz, n);
+        suffix[block_end - 1] = line[block_end - 1];
+        for (ptrdiff_t k = block_end - 2; k >= block; --k)
+          suffix[k] = op(line[k], suffix[k + 1]);
+      }
 
-        dst(i, j) = filtered;
+      T prefix = T(0);
+      for (ptrdiff_t k = 0; k < n; ++k)
+      {
+        prefix = (k % kernel_sz == 0) ? line[k] : op(prefix, line[k]);
+        if (k >= kernel_sz - 1)
+          dst_row[k - kernel_sz + 1] = op(suffix[k - kernel_sz + 1], prefix);
       }
+    }
   }
-  break;
-  case BorderCondition::BC_WRAP:
-  {
-    // Top border pixels.
-    for(ptrdiff_t i = 0; i < kernel_radius; ++i)
-      for (ptrdiff_t j = 0; j < src.width(); ++j)
-      {
-        const auto i_begin = i - kernel_radius;
-        const auto k_begin = -i_begin;
 
-        T filtered = T(0);
-        for(ptrdiff_t ik = k_begin; ik < kernel_sz; ++ik)
-          filtered += kernel[ik] * src(i_begin + ik, j);
+  // Same as morph_x_rows down the columns [col_begin, col_end), processed in chunks of
+  // columns a row segment at a time.
+  template<typename T, typename Op>
+  void morph_y_cols(ConstImageView<T> src, ptrdiff_t kernel_radius, BorderCondition bc, Op op, ImageView<T> dst,
+    ptrdiff_t col_begin, ptrdiff_t col_end)
+  {
+    constexpr ptrdiff_t chunk_cols = 256;
 
-        const auto wrap_begin = src.height() - k_begin;
-        for (ptrdiff_t ik = 0; ik < k_begin; ++ik)
-          filtered += kernel[ik] * src(wrap_begin + ik, j);
+    const auto h = src.height();
+    const auto kernel_sz = 2 * kernel_radius + 1;
+    const auto n = h + 2 * kernel_radius;
 
-        dst(i, j) = filtered;
-      }
+    const auto chunk_sz = std::min(chunk_cols, col_end - col_begin);
+    ScratchImage<T> suffix(n, chunk_sz);
+    std::vector<T> prefix(static_cast<size_t>(chunk_sz));
+    std::vector<T> zero_row(size_t(chunk_sz), T(0));
 
-    // Bottom border pixels.
-    for(ptrdiff_t i = src.height() - kernel_radius; i < src.height(); ++i)
-      for (ptrdiff_t j = 0; j < src.width(); ++j)
+    for (ptrdiff_t x0 = col_begin; x0 < col_end; x0 += chunk_cols)
+    {
+      const auto cols = std::min(chunk_cols, col_end - x0);
+      const auto line = [&](ptrdiff_t k)
       {
-        const auto i_begin = i - kernel_radius;
-        const auto k_end = src.height() - i_begin;
+        const auto index = border_index(k - kernel_radius, h, bc);
+        return index < 0 ? zero_row.data() : src.row(index) + x0;
+      };
 
-        T filtered = T(0);
-        for(ptrdiff_t ik = 0; ik < k_end; ++ik)
-          filtered += kernel[ik] * src(i_begin + ik, j);
-
-        for (ptrdiff_t ik = k_end; ik < kernel_sz; ++ik)
-          filtered += kernel[ik] * src(ik - k_end, j);
+      for (ptrdiff_t block = 0; block < n; block += kernel_sz)
+      {
+        const auto block_end = std::min(block + kernel_sz, n);
+        std::copy_n(line(block_end - 1), cols, suffix.view().row(block_end - 1));
+        for (ptrdiff_t k = block_end - 2; k >= block; --k)
+        {
+          const auto line_row = line(k);
+          const auto next_row = suffix.view().row(k + 1);
+          const auto suffix_row = suffix.view().row(k);
+          for (ptrdiff_t j = 0; j < cols; ++j)
+            suffix_row[j] = op(line_row[j], next_row[j]);
+        }
+      }
 
-        dst(i, j) = filtered;
+      for (ptrdiff_t k = 0; k < n; ++k)
+      {
+        const auto line_row = line(k);
+        if (k % kernel_sz == 0)
+          std::copy_n(line_row, cols, prefix.data());
+        else
+          for (ptrdiff_t j = 0; j < cols; ++j)
+            prefix[j] = op(prefix[j], line_row[j]);
+
+        if (k >= kernel_sz - 1)
+        {
+          const auto suffix_row = suffix.view().row(k - kernel_sz + 1);
+          const auto dst_row = dst.row(k - kernel_sz + 1) + x0;
+          for (ptrdiff_t j = 0; j < cols; ++j)
+            dst_row[j] = op(suffix_row[j], prefix[j]);
+        }
       }
+    }
   }
-  break;
+
+  template<typename T, typename Op>
+  void morph_filter_x(ConstImageView<T> src, ptrdiff_t kernel_radius, BorderCondition bc, Op op, ImageView<T> dst)
+  {
+    parallel_for_rows(src.height(), src.width(), [&](ptrdiff_t row_begin, ptrdiff_t row_end)
+      {
+        morph_x_rows(src, kernel_radius, bc, op, dst, row_begin, row_end);
+      });
   }
-}
 
-template<typename T>
-void diff_filter_x(Image2d<T> const& src, BorderCondition bc, Image2d<T>& dst)
-{
-  T diff_kernel[] = { T(-1), T(0), T(1) };
-  filter_x(src, diff_kernel, 3, bc, dst);
+  template<typename T, typename Op>
+  void morph_filter_y(ConstImageView<T> src, ptrdiff_t kernel_radius, BorderCondition bc, Op op, ImageView<T> dst)
+  {
+    const auto min_band_cols = std::max<ptrdiff_t>(64, min_band_pixels / std::max<ptrdiff_t>(src.height(), 1));
+    parallel_for(0, src.width(), min_band_cols, [&](ptrdiff_t col_begin, ptrdiff_t col_end)
+      {
+        morph_y_cols(src, kernel_radius, bc, op, dst, col_begin, col_end);
+      });
+  }
+
+  template<typename T, typename Op>
+  void morph_filter(ConstImageView<T> src, ptrdiff_t kernel_radius_y, ptrdiff_t kernel_radius_x, BorderCondition bc, 
+    Op op, ImageView<T> dst)
+  {
+    ScratchImage<T> tmp(src.height(), src.width());
+    morph_filter_x(src, kernel_radius_x, bc, op, tmp.view());
+    morph_filter_y(tmp.view(), kernel_radius_y, bc, op, dst);
+  }
 }
 
+// Minimum and maximum over a (2 * kernel_radius_y + 1) x (2 * kernel_radius_x + 1)
+// rectangle, computed separably at constant cost per pixel. Pixels outside the image
+// follow the border condition, BC_CLAMP leaves the borders unaffected.
 template<typename T>
-void diff_filter_y(Image2d<T> const& src, BorderCondition bc, Image2d<T>& dst)
+void min_filter(ConstImageView<T> src, ptrdiff_t kernel_radius_y, ptrdiff_t kernel_radius_x, BorderCondition bc, ImageView<T> dst)
 {
-  T diff_kernel[] = { T(-1), T(0), T(1) };
-  filter_y(src, diff_kernel, 3, bc, dst);
+  detail::morph_filter(src, kernel_radius_y, kernel_radius_x, bc, detail::MinOp(), dst);
 }
 
 template<typename T>
-void sobel_x(Image2d<T> const& src, BorderCondition bc, Image2d<T>& dst)
+void min_filter(Image2d<T> const& src, ptrdiff_t kernel_radius_y, ptrdiff_t kernel_radius_x, BorderCondition bc, Image2d<T>& dst)
 {
-  Image2d<T> tmp(src.height(), src.width());
-
-  T avg_kernel[] = { T(1), T(2), T(1) };
-  filter_x(src, avg_kernel, 3, bc, tmp);
-
-  diff_filter_x(tmp, bc, dst);
+  min_filter(src.view(), kernel_radius_y, kernel_radius_x, bc, dst.view());
 }
 
 template<typename T>
-void sobel_y(Image2d<T> const& src, BorderCondition bc, Image2d<T>& dst)
+void max_filter(ConstImageView<T> src, ptrdiff_t kernel_radius_y, ptrdiff_t kernel_radius_x, BorderCondition bc, ImageView<T> dst)
 {
-  Image2d<T> tmp(src.height(), src.width());
-
-  T avg_kernel[] = { T(1), T(2), T(1) };
-  filter_y(src, avg_kernel, 3, bc, tmp);
-
-  diff_filter_y(tmp, bc, dst);
+  detail::morph_filter(src, kernel_radius_y, kernel_radius_x, bc, detail::MaxOp(), dst);
 }
 
 template<typename T>
-void sobel_abs(Image2d<T> const& src, BorderCondition bc, Image2d<T>& dst)
+void max_filter(Image2d<T> const& src, ptrdiff_t kernel_radius_y, ptrdiff_t kernel_radius_x, BorderCondition bc, Image2d<T>& dst)
 {
-  const auto w = src.width();
-  const auto h = src.height();
-
-  Image2d<T> grad_x(h, w);
-  sobel_x(src, bc, grad_x);
-
-  Image2d<T> grad_y(h, w);
-  sobel_y(src, bc, grad_y);
-
-  foreach2d(dst, y, x)
-  {
-    const auto gx = grad_x(y, x);
-    const auto gy = grad_y(y, x);
-    dst(y, x) = std::sqrt(gx * gx + gy * gy);
-  }
+  max_filter(src.view(), kernel_radius_y, kernel_radius_x, bc, dst.view());
 }
 
+// Morphological operations with a rectangular structuring element.
 template<typename T>
-void box_filter_x(Image2d<T> const& src, ptrdiff_t kernel_radius, BorderCondition bc, Image2d<T>& dst)
+void erode(ConstImageView<T> src, ptrdiff_t kernel_radius_y, ptrdiff_t kernel_radius_x, BorderCondition bc, ImageView<T> dst)
 {
-  const auto kernel_sz = 2 * kernel_radius + 1;
-  Image2d<T> box_kernel(1, kernel_sz);
-  fill(box_kernel, T(1));
-
-  filter_x(src, box_kernel.data(), kernel_sz, bc, dst);
+  min_filter(src, kernel_radius_y, kernel_radius_x, bc, dst);
 }
 
 template<typename T>
-void box_filter_y(Image2d<T> const& src, ptrdiff_t kernel_radius, BorderCondition bc, Image2d<T>& dst)
+void erode(Image2d<T> const& src, ptrdiff_t kernel_radius_y, ptrdiff_t kernel_radius_x, BorderCondition bc, Image2d<T>& dst)
 {
-  const auto kernel_sz = 2 * kernel_radius + 1;
-  Image2d<T> box_kernel(1, kernel_sz);
-  fill(box_kernel, T(1));
-
-  filter_y(src, box_kernel.data(), kernel_sz, bc, dst);
+  erode(src.view(), kernel_radius_y, kernel_radius_x, bc, dst.view());
 }
 
+// Square erosion of a mask: 1 where the whole window is non-zero and 0 elsewhere (so
+// a 0/255 mask gives 0/1). The pixels outside of the image are 0, so the mask is eroded
+// from its borders as well. Use the overloads above for the plain minimum.
 template<typename T>
-void box_filter(Image2d<T> const& src, ptrdiff_t kernel_radius_y, ptrdiff_t kernel_radius_x, BorderCondition bc, Image2d<T>& dst)
+void erode(Image2d<T> const& src, ptrdiff_t kernel_radius, Image2d<T>& dst)
 {
-  Image2d<T> tmp(src.height(), src.width());
-  box_filter_x(src, kernel_radius_x, bc, tmp);
-  box_filter_y(tmp, kernel_radius_y, bc, dst);
-}
+  static_assert(std::is_integral_v<T>, "Erosion only supports integral images.");
 
-namespace detail
-{
-  template<typename T>
-  void create_gauss_kernel(ptrdiff_t kernel_radius, T sigma, Image2d<T>& dst)
-  {
-    const auto kernel_sz = 2 * kernel_radius + 1;
-    const auto factor = T(0.5) / (sigma * sigma);
-    dst.alloc(1, kernel_sz);
-    foreach_x(dst, x)
+  erode(src.view(), kernel_radius, kernel_radius, BorderCondition::BC_ZERO, dst.view());
+  parallel_for_rows(dst.height(), dst.width(), [&](ptrdiff_t row_begin, ptrdiff_t row_end)
     {
-      const auto dx = x - kernel_radius;
-      dst(0, x) = exp(-factor * T(dx * dx));
-    }
-
-    // Normalize the kernel.
-    const auto normalization = T(1) / sum(dst);
-    mul(dst, normalization, dst);
-  }
+      for (ptrdiff_t i = row_begin; i < row_end; ++i)
+      {
+        const auto row = dst.row(i);
+        for (ptrdiff_t j = 0; j < dst.width(); ++j)
+          row[j] = row[j] != T(0) ? T(1) : T(0);
+      }
+    });
 }
 
 template<typename T>
-void gauss_filter_x(Image2d<T> const& src, ptrdiff_t kernel_radius, T sigma, BorderCondition bc, Image2d<T>& dst)
+void dilate(ConstImageView<T> src, ptrdiff_t kernel_radius_y, ptrdiff_t kernel_radius_x, BorderCondition bc, ImageView<T> dst)
 {
-  static_assert(std::is_floating_point_v<T>, "Gauss filter only supports floating point images.");
-
-  Image2d<T> gauss_kernel;
-  detail::create_gauss_kernel(kernel_radius, sigma, gauss_kernel);
-
-  filter_x(src, gauss_kernel.data(), gauss_kernel.width(), bc, dst);
+  max_filter(src, kernel_radius_y, kernel_radius_x, bc, dst);
 }
 
 template<typename T>
-void gauss_filter_y(Image2d<T> const& src, ptrdiff_t kernel_radius, T sigma, BorderCondition bc, Image2d<T>& dst)
+void dilate(Image2d<T> const& src, ptrdiff_t kernel_radius_y, ptrdiff_t kernel_radius_x, BorderCondition bc, Image2d<T>& dst)
 {
-  static_assert(std::is_floating_point_v<T>, "Gauss filter only supports floating point images.");
-
-  Image2d<T> gauss_kernel;
-  detail::create_gauss_kernel(kernel_radius, sigma, gauss_kernel);
-
-  filter_y(src, gauss_kernel.data(), gauss_kernel.width(), bc, dst);
+  dilate(src.view(), kernel_radius_y, kernel_radius_x, bc, dst.view());
 }
 
 template<typename T>
-void gauss_filter(Image2d<T> const& src, ptrdiff_t kernel_radius_y, ptrdiff_t kernel_radius_x, T sigma_y, T sigma_x, BorderCondition bc, Image2d<T>& dst)
+void morph_open(ConstImageView<T> src, ptrdiff_t kernel_radius_y, ptrdiff_t kernel_radius_x, BorderCondition bc, ImageView<T> dst)
 {
-  Image2d<T> tmp(src.height(), src.width());
-  gauss_filter_x(src, kernel_radius_x, sigma_x, bc, tmp);
-  gauss_filter_y(tmp, kernel_radius_y, sigma_y, bc, dst);
+  ScratchImage<T> eroded(src.height(), src.width());
+  erode(src, kernel_radius_y, kernel_radius_x, bc, eroded.view());
+  dilate(eroded.view(), kernel_radius_y, kernel_radius_x, bc, dst);
 }
 
-template<typename T, typename U>
-void threshold_image(Image2d<T> const& src, T threshold, U true_val, U false_val, Image2d<U>& dst)
+template<typename T>
+void morph_open(Image2d<T> const& src, ptrdiff_t kernel_radius_y, ptrdiff_t kernel_radius_x, BorderCondition bc, Image2d<T>& dst)
 {
-  foreach2d(src, y, x)
-  {
-    dst(y, x) = src(y, x) >= threshold ? true_val : false_val;
-  }
+  morph_open(src.view(), kernel_radius_y, kernel_radius_x, bc, dst.view());
 }
 
 template<typename T>
-void erode(Image2d<T> const& src, ptrdiff_t kernel_radius, Image2d<T>& dst)
+void morph_close(ConstImageView<T> src, ptrdiff_t kernel_radius_y, ptrdiff_t kernel_radius_x, BorderCondition bc, ImageView<T> dst)
 {
-  static_assert(std::is_integral_v<T>, "Erosion only supports integral images.");
-
-  const auto kernel_sz = 2 * kernel_radius + 1;
-
-  for (ptrdiff_t i = 0; i < src.height(); ++i)
-  {
-    if (i < kernel_radius || i >= (src.height() - kernel_radius))
-    {
-      for (ptrdiff_t j = 0; j < src.width(); ++j)
-        dst(i, j) = T(0);
-    }
-
-    for (ptrdiff_t j = 0; j < src.width(); ++j)
-    {
-      if (j < kernel_radius || j >= (src.width() - kernel_radius))
-      {
-        dst(i, j) = T(0);
-        continue;
-      }
-
-      ptrdiff_t sum = 0;
-      for(ptrdiff_t ik = - kernel_radius; ik <= kernel_radius; ++ik)
-        for (ptrdiff_t jk = -kernel_radius; jk <= kernel_radius; ++jk)
-        {
-          if (src(i + ik, j + jk))
-            ++sum;
-        }
-
-      if (sum == kernel_sz * kernel_sz)
-        dst(i, j) = T(1);
-      else
-        dst(i, j) = T(0);
-    }
-  }
+  ScratchImage<T> dilated(src.height(), src.width());
+  dilate(src, kernel_radius_y, kernel_radius_x, bc, dilated.view());
+  erode(dilated.view(), kernel_radius_y, kernel_radius_x, bc, dst);
 }
 
-namespace constants
+template<typename T>
+void morph_close(Image2d<T> const& src, ptrdiff_t kernel_radius_y, ptrdiff_t kernel_radius_x, BorderCondition bc, Image2d<T>& dst)
 {
-  constexpr const double pi = 3.14159265359;
-  constexpr const double two_pi = pi * 2.;
-  constexpr const double half_pi = pi / 2.;
-  constexpr const double quarter_pi = pi / 4.;
-  constexpr const double eighth_pi = pi / 8.;
+  morph_close(src.view(), kernel_radius_y, kernel_radius_x, bc, dst.view());
 }
 
 namespace detail
 {
   ptrdiff_t clamp_index(ptrdiff_t index, ptrdiff_t size);
 
-  int8_t canny_get_angle_bin(double angle);
-
   template<typename T>
-  void non_max_suppression(Image2d<T> const& grad, Image2d<int8_t> const& dirs, Image2d<unsigned char>& dst)
+  void non_max_suppression(ConstImageView<T> grad, ImageView<int8_t const> dirs, ImageView<unsigned char> dst)
   {
     const auto w = grad.width();
     const auto h = grad.height();
@@ -809,35 +2272,30 @@ namespace detail
     }
   }
 
-  void hysteresis_edge_tracking(Image2d<unsigned char>& dst);
+  // Hysteresis of the Canny edge detection: pixels marked 2 (strong) and the pixels
+  // marked 1 (weak) that are 8-connected to them through other marked pixels are set
+  // to 255, unconnected weak pixels stay 1. The serial version tracks the edges from
+  // the strong pixels, the parallel version labels the marked pixels with a union-find
+  // per row band and merges the labels at the band borders; both give the same result.
+  // Images of more than 2^31 - 1 pixels always take the serial version.
+  void hysteresis_edge_tracking_serial(ImageView<unsigned char> dst);
+  void hysteresis_edge_tracking_parallel(ImageView<unsigned char> dst, ptrdiff_t n_bands);
+
+  // Uses the parallel version for images of several bands.
+  void hysteresis_edge_tracking(ImageView<unsigned char> dst);
 }
 
 template<typename T>
-void canny_edge_detection(Image2d<T> const& src, T low_threshold, T high_threshold, Image2d<unsigned char>& dst)
+void canny_edge_detection(ConstImageView<T> src, T low_threshold, T high_threshold, ImageView<unsigned char> dst)
 {
   const auto w = src.width();
   const auto h = src.height();
 
-  Image2d<T> grad_x(h, w);
-  sobel_x(src, BorderCondition::BC_CLAMP, grad_x);
+  ScratchImage<T> grad_sq(h, w);
+  ScratchImage<int8_t> directions(h, w);
+  sobel_gradient(src, BorderCondition::BC_CLAMP, GradientNorm::SquaredL2, grad_sq.view(), directions.view());
 
-  Image2d<T> grad_y(h, w);
-  sobel_y(src, BorderCondition::BC_CLAMP, grad_y);
-
-  Image2d<T> grad_sq(h, w);
-  Image2d<int8_t> directions(h, w);
-  foreach2d(src, y, x)
-  {
-    const auto gx = grad_x(y, x);
-    const auto gy = grad_y(y, x);
-
-    grad_sq(y, x) = gx * gx + gy * gy;
-
-    const double angle = (gx == T(0)) ? constants::half_pi : atan2(gy, gx);
-    directions(y, x) = detail::canny_get_angle_bin(angle);
-  }
-
-  detail::non_max_suppression(grad_sq, directions, dst);
+  detail::non_max_suppression<T>(grad_sq.view(), directions.view(), dst);
 
   // Threshold application.
   const auto lo_sq = low_threshold * low_threshold;
@@ -860,6 +2318,45 @@ void canny_edge_detection(Image2d<T> const& src, T low_threshold, T high_thresho
   }
 }
 
+template<typename T>
+void canny_edge_detection(Image2d<T> const& src, T low_threshold, T high_threshold, Image2d<unsigned char>& dst)
+{
+  canny_edge_detection(src.view(), low_threshold, high_threshold, dst.view());
+}
+
+namespace detail
+{
+  // dst_row[j] = (src_row[j] - offset) * scale, clamped to [0, 255] and truncated.
+  template<typename T>
+  void display_gray_row(T const* src_row, ptrdiff_t width, T offset, T scale, uint8_t* dst_row)
+  {
+    for (ptrdiff_t j = 0; j < width; ++j)
+    {
+      const T val = (src_row[j] - offset) * scale;
+      dst_row[j] = static_cast<uint8_t>(val > T(0) ? (val < T(255) ? val : T(255)) : T(0));
+    }
+  }
+
+  // Average of the red, green and blue channels of 0xAARRGGBB pixels.
+  template<typename T>
+  void rgb32_average_row(uint32_t const* src_row, ptrdiff_t width, T* dst_row)
+  {
+    for (ptrdiff_t j = 0; j < width; ++j)
+    {
+      const auto rgb = src_row[j];
+      dst_row[j] = T(0.333333f) * T(int((rgb >> 16) & 0xff) + int((rgb >> 8) & 0xff) + int(rgb & 0xff));
+    }
+  }
+}
+
+// Maps [lo, hi] linearly to the 8 bit values [0, 254] for display, truncating. Values
+// outside of the range are clamped, a constant image (lo == hi) becomes 0.
+void to_display_gray(ConstImageView<float> src, float lo, float hi, ImageView<unsigned char> dst);
+
+// Averages the red, green and blue channels of 0xAARRGGBB pixels, the layout of 
+// QImage::Format_RGB32 and Format_ARGB32.
+void rgb32_to_gray(ConstImageView<uint32_t> src, ImageView<float> dst);
+
 template<typename T>
 void export_image(std::string const& file_name, Image2d<T>& img)
 {
@@ -885,7 +2382,20 @@ class Operation
 public:
   virtual ~Operation() {}
 
-  virtual void perform(Image2d<float> const& in, Image2d<float>& out) const = 0;
+  // Pixel type the operation reads when the preceding stage produces the given type,
+  // OperationChain converts the image when they differ.
+  virtual PixelType inputType(PixelType in) const { return in; }
+
+  // Pixel type the operation writes for an input of the given type.
+  virtual PixelType outputType(PixelType in) const { return in; }
+
+  // The input has the type inputType() selects and the output the one of outputType().
+  virtual void perform(AnyConstImageView const& in, AnyImageView const& out) const = 0;
+
+  // Number of rows above and below an output row that the operation reads. Operations
+  // that depend on the whole image (e.g. Canny edge tracking) return std::nullopt and
+  // cannot be executed on image strips.
+  virtual std::optional<ptrdiff_t> haloRows() const { return std::nullopt; }
 };
 
 class ThresholdOp : public Operation
@@ -893,7 +2403,10 @@ class ThresholdOp : public Operation
 public:
   ThresholdOp(ThresholdConfig const& config); 
 
-  void perform(Image2d<float> const& in, Image2d<float>& out) const override;
+  // Integer true and false values are written to the smallest pixel type holding them.
+  PixelType outputType(PixelType in) const override;
+  void perform(AnyConstImageView const& in, AnyImageView const& out) const override;
+  std::optional<ptrdiff_t> haloRows() const override;
 
 private:
   ThresholdConfig config_;
@@ -904,7 +2417,10 @@ class FilterOp : public Operation
 public:
   FilterOp(FilterConfig const& config);
 
-  void perform(Image2d<float> const& in, Image2d<float>& out) const override;
+  PixelType inputType(PixelType in) const override;
+  PixelType outputType(PixelType in) const override;
+  void perform(AnyConstImageView const& in, AnyImageView const& out) const override;
+  std::optional<ptrdiff_t> haloRows() const override;
 
 private:
   FilterConfig config_;
@@ -915,7 +2431,10 @@ class GradOp : public Operation
 public:
   GradOp(GradConfig const& config);
 
-  void perform(Image2d<float> const& in, Image2d<float>& out) const override;
+  PixelType inputType(PixelType in) const override;
+  PixelType outputType(PixelType in) const override;
+  void perform(AnyConstImageView const& in, AnyImageView const& out) const override;
+  std::optional<ptrdiff_t> haloRows() const override;
 
 private:
   GradConfig config_;
@@ -926,22 +2445,193 @@ class CannyOp : public Operation
 public:
   CannyOp(CannyConfig const& config);
 
-  void perform(Image2d<float> const& in, Image2d<float>& out) const override;
+  // Reads float images and writes the edge mask as U8.
+  PixelType inputType(PixelType in) const override;
+  PixelType outputType(PixelType in) const override;
+  void perform(AnyConstImageView const& in, AnyImageView const& out) const override;
 
 private:
   CannyConfig config_;
 };
 
+class MorphOp : public Operation
+{
+public:
+  MorphOp(MorphConfig const& config);
+
+  void perform(AnyConstImageView const& in, AnyImageView const& out) const override;
+  std::optional<ptrdiff_t> haloRows() const override;
+
+private:
+  MorphConfig config_;
+};
+
+enum class ExecutionMode
+{
+  // Every operation processes the whole image before the next one starts.
+  Staged,
+
+  // Consecutive operations that support it (see Operation::haloRows) are run together
+  // on cache-sized strips of rows, extended by the halo rows the following
+  // operations depend on. The output is identical to the staged execution.
+  Fused
+};
+
+namespace detail
+{
+  class AnyScratchImage;
+  struct ChainScratch;
+}
+
+// Measurements of an operation in the last executeChain() call (see OperationChain::setProfiling()).
+struct OpProfile
+{
+  int id = 0;
+
+  // Wall time of the operation, including the conversion of its input.
+  double seconds = 0.0;
+
+  // Image buffers newly allocated while the operation ran, see allocated_image_bytes().
+  size_t bytes_allocated = 0;
+
+  // Input pixels per second.
+  double pixels_per_second = 0.0;
+
+  // Set if the cached result was reused (see OperationChain::setCaching()), the
+  // measurements are zero then.
+  bool cached = false;
+};
+
+// Cancellation flag and progress report of a chain execution, shared between the
+// thread executing it and the one controlling it.
+class ExecutionControl
+{
+public:
+  // The execution stops at the next row band of the running operation (see 
+  // CancellationScope), or before the next stage for the serial parts of operations.
+  void cancel();
+  bool isCancelled() const;
+
+  // Called by the executing thread after every stage with the number of finished
+  // stages and their total. Needs to be set before the execution starts.
+  void setProgressCallback(std::function<void(size_t, size_t)> callback);
+  void reportProgress(size_t done, size_t total) const;
+
+private:
+  friend class OperationChain;
+
+  std::atomic<bool> cancelled_{ false };
+  std::function<void(size_t, size_t)> progress_callback_;
+};
+
 class OperationChain
 {
 public:
+  void setExecutionMode(ExecutionMode mode);
+  ExecutionMode executionMode() const;
+
+  // Number of output rows per strip in the fused mode, 0 selects it automatically.
+  void setStripRows(ptrdiff_t rows);
+
+  // With caching enabled, the output of every stage is kept and a new execution on 
+  // the same input only recomputes the stages from the first added, modified or 
+  // removed operation on. Stages are executed one by one (the fused mode is not used).
+  // The input is identified by its buffer and size, so invalidateCache() needs to be 
+  // called when its pixels change in place.
+  void setCaching(bool enabled);
+  bool caching() const;
+  void invalidateCache();
+
+  // With profiling enabled, every execution records an OpProfile per operation. The
+  // operations are then executed one by one (the fused mode is not used), so that 
+  // they can be timed separately. Disabled, it costs a single check per execution.
+  void setProfiling(bool enabled);
+  bool profiling() const;
+
+  // Profiles of the last execution, in the order of the chain.
+  std::vector<OpProfile> profile() const;
+
   void addOperation(int op_id, OpConfig const& config);
   void modifyOperation(int op_id, OpConfig const& config);
   void removeOperation(int op_id);
 
+  // Pixel type of the chain's result for an input of the given type. Every stage works on
+  // the type its operation selects, conversions are only inserted where these differ.
+  PixelType outputType(PixelType in) const;
+
+  // Applies the chain to the input. The output view needs to have the size of the input,
+  // the result is converted if the output has another type than outputType().
+  void executeChain(AnyConstImageView const& in, AnyImageView const& out) const;
+
+  // Same as above, (re)allocating the output image if its size differs from the input.
   void executeChain(Image2d<float> const& in, Image2d<float>& out) const;
 
+  // Same as above, the output image gets the type of outputType() and is not converted.
+  void executeChain(AnyConstImageView const& in, AnyImage& out) const;
+
+  // Same as above, observed through control (see ExecutionControl). Returns false if 
+  // the execution was cancelled, the output is incomplete then. Cached stages finished
+  // before the cancellation are kept.
+  bool executeChain(AnyConstImageView const& in, AnyImageView const& out, ExecutionControl const& control) const;
+  bool executeChain(Image2d<float> const& in, Image2d<float>& out, ExecutionControl const& control) const;
+
+  // Applies the chain to the given pyramid level, e.g. for a coarse preview. The 
+  // operation parameters (kernel radii, sigmas) apply at the resolution of the level.
+  void executeChain(GaussPyramid const& pyramid, size_t level, AnyImageView const& out) const;
+  void executeChain(GaussPyramid const& pyramid, size_t level, Image2d<float>& out) const;
+
+  // Applies the chain to every input, writing to the output of the same index. The 
+  // images are distributed over up to max_threads() workers, each executing whole 
+  // images with one set of scratch images that is reused while the image size stays 
+  // the same. This amortizes the per-call overhead for many small images. Batches are
+  // neither cached nor profiled.
+  void executeBatch(std::vector<AnyConstImageView> const& in, std::vector<AnyImageView> const& out) const;
+
+  // Same as above, resizing the output list and (re)allocating the output images whose
+  // size differs from their input.
+  void executeBatch(std::vector<Image2d<float>> const& in, std::vector<Image2d<float>>& out) const;
+
 private:
+  struct Stage
+  {
+    int id;
+    OpConfig config;
+    std::unique_ptr<Operation> op;
+
+    // Cached output of the stage (see setCaching()).
+    mutable AnyImage result;
+  };
+
+  using StageIterator = std::vector<Stage>::const_iterator;
+
+  // The executions below return false if they were cancelled through control (which may be null).
+  bool execute(AnyConstImageView const& in, AnyImageView const& out, ExecutionControl const* control) const;
+  bool executeFused(StageIterator first, StageIterator last, AnyConstImageView const& in, AnyImageView const& out,
+    ExecutionControl const* control) const;
+  bool executeCached(AnyConstImageView const& in, AnyImageView const& out, std::vector<OpProfile>* profile,
+    ExecutionControl const* control) const;
+  bool executeUncached(AnyConstImageView const& in, AnyImageView const& out, detail::ChainScratch& scratch,
+    std::vector<OpProfile>* profile, ExecutionControl const* control) const;
+
+  // Performs a single stage, measuring it into the profile if there is one.
+  static void performStage(Stage const& stage, AnyConstImageView const& in, AnyImageView const& out,
+    detail::AnyScratchImage* converted, std::vector<OpProfile>* profile);
+
+  // Marks the stages from the given index on as not cached.
+  void invalidateFrom(size_t stage_index);
+
   // Chain of operations with corresponding unique IDs.
-  std::vector<std::pair<int, std::unique_ptr<Operation>>> chain_;
+  std::vector<Stage> chain_;
+
+  ExecutionMode mode_ = ExecutionMode::Staged;
+  ptrdiff_t strip_rows_ = 0;
+
+  bool caching_ = false;
+  mutable std::mutex cache_mutex_;
+  mutable size_t cached_stages_ = 0;
+  mutable AnyConstImageView cached_input_;
+
+  bool profiling_ = false;
+  mutable std::mutex profile_mutex_;
+  mutable std::vector<OpProfile> profile_;
 };
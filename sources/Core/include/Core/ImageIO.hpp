@@ -0,0 +1,16 @@
+#pragma once
+
+#include <Core/Core.hpp>
+
+#include <string>
+
+// Reads a PGM or PPM file (P2, P3, P5 or P6, 8 or 16 bit) as a gray image, color
+// pixels are averaged over the channels. img is only reallocated if its size differs,
+// so that reading a series of same-sized files reuses the buffer. Throws
+// std::runtime_error if the file cannot be read, or if its header is invalid or
+// describes more pixels than the file holds.
+void read_pnm(std::string const& file_name, Image2d<float>& img);
+
+// Writes a binary PGM file, 16 bit for U16 images and 8 bit otherwise. Float pixels
+// are rounded and saturated to [0, 255].
+void write_pgm(std::string const& file_name, AnyConstImageView const& img);
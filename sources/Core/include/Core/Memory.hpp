@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stddef.h>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace detail
+{
+  // Alignment (in bytes) of the image buffer and of every image row.
+  constexpr size_t image_row_alignment = 64;
+
+  struct AlignedDelete
+  {
+    void operator()(unsigned char* ptr) const;
+  };
+
+  using AlignedBuffer = std::unique_ptr<unsigned char[], AlignedDelete>;
+
+  // Allocates a buffer aligned to image_row_alignment, zeroed unless zero_init is false.
+  AlignedBuffer alloc_aligned_buffer(size_t bytes, bool zero_init = true);
+}
+
+// Bytes allocated for image buffers (by Image2d and by ImagePool misses) since the
+// start of the program, counted over all threads.
+size_t allocated_image_bytes();
+
+struct ImagePoolStats
+{
+  // Buffers that had to be freshly allocated.
+  size_t allocations = 0;
+
+  // Buffers served from the pool, and the bytes they would have allocated.
+  size_t reuses = 0;
+  size_t bytes_reused = 0;
+};
+
+// Cache of image buffers keyed by their size in bytes. Scratch images of the
+// image operations (see ScratchImage) are drawn from and returned to the global
+// pool, so repeated executions on same-sized images do not allocate. Buffers
+// handed out by the pool are not cleared. The pool is thread-safe.
+class ImagePool
+{
+public:
+  static ImagePool& global();
+
+  detail::AlignedBuffer acquire(size_t bytes);
+  void release(detail::AlignedBuffer buffer, size_t bytes);
+
+  // Upper bound of the memory kept in the pool, buffers beyond it are freed on release.
+  void setCapacity(size_t bytes);
+  size_t capacity() const;
+  size_t cachedBytes() const;
+
+  // Frees all cached buffers.
+  void clear();
+
+  ImagePoolStats stats() const;
+  void resetStats();
+
+private:
+  mutable std::mutex mutex_;
+  std::unordered_multimap<size_t, detail::AlignedBuffer> buffers_;
+  size_t capacity_ = size_t(1) << 30;
+  size_t cached_bytes_ = 0;
+  ImagePoolStats stats_;
+};
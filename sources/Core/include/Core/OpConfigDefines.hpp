@@ -8,15 +8,32 @@ struct ThresholdConfig
   float thresh;
   float true_val;
   float false_val;
+
+  bool operator==(ThresholdConfig const& other) const
+  {
+    return thresh == other.thresh && true_val == other.true_val && false_val == other.false_val;
+  }
 };
 
 struct FilterConfig
 {
+  // FIR convolves with a kernel of the given radii, IIR is the recursive
+  // approximation whose cost does not depend on sigma (the radii are unused).
+  enum class Method { FIR, IIR };
+
   ptrdiff_t kernel_radius_x;
   ptrdiff_t kernel_radius_y;
 
   float sigma_x;
   float sigma_y;
+
+  Method method = Method::FIR;
+
+  bool operator==(FilterConfig const& other) const
+  {
+    return kernel_radius_x == other.kernel_radius_x && kernel_radius_y == other.kernel_radius_y &&
+      sigma_x == other.sigma_x && sigma_y == other.sigma_y && method == other.method;
+  }
 };
 
 struct GradConfig
@@ -24,12 +41,37 @@ struct GradConfig
   enum class GradType { GradX, GradY, GradAbs };
 
   GradType type;
+
+  bool operator==(GradConfig const& other) const
+  {
+    return type == other.type;
+  }
 };
 
 struct CannyConfig
 {
   float lo_thresh;
   float hi_thresh;
+
+  bool operator==(CannyConfig const& other) const
+  {
+    return lo_thresh == other.lo_thresh && hi_thresh == other.hi_thresh;
+  }
+};
+
+struct MorphConfig
+{
+  enum class MorphType { Erode, Dilate, Open, Close };
+
+  MorphType type;
+
+  ptrdiff_t kernel_radius_x;
+  ptrdiff_t kernel_radius_y;
+
+  bool operator==(MorphConfig const& other) const
+  {
+    return type == other.type && kernel_radius_x == other.kernel_radius_x && kernel_radius_y == other.kernel_radius_y;
+  }
 };
 
-using OpConfig = std::variant<ThresholdConfig, FilterConfig, GradConfig, CannyConfig>;
+using OpConfig = std::variant<ThresholdConfig, FilterConfig, GradConfig, CannyConfig, MorphConfig>;
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stddef.h>
+#include <atomic>
+#include <functional>
+
+// Caps the number of threads used by the parallel image operations. A value of
+// 0 restores the default (hardware concurrency), 1 forces serial execution.
+void set_max_threads(size_t n);
+size_t max_threads();
+
+// While alive, the parallel loops started by the constructing thread (including the
+// nested ones) check flag between chunks of about min_band elements and skip the rest
+// of their range once it is set. Their output is incomplete then. This makes long
+// operations cancellable without them knowing about it, except where a serial step
+// relies on the output of a parallel loop (e.g. as indices): it has to check
+// cancellation_requested() after the loop and stop.
+class CancellationScope
+{
+public:
+  explicit CancellationScope(std::atomic<bool> const& flag);
+  ~CancellationScope();
+
+  CancellationScope(CancellationScope const&) = delete;
+  CancellationScope& operator=(CancellationScope const&) = delete;
+
+private:
+  std::atomic<bool> const* prev_flag_;
+};
+
+// True if the flag of the innermost CancellationScope of the calling thread is set.
+bool cancellation_requested();
+
+namespace detail
+{
+  // Bands smaller than this (in pixels) are not worth handing to another thread.
+  constexpr ptrdiff_t min_band_pixels = ptrdiff_t(1) << 14;
+
+  void parallel_for_impl(ptrdiff_t begin, ptrdiff_t end, ptrdiff_t min_band,
+    std::function<void(ptrdiff_t, ptrdiff_t)> const& func);
+}
+
+// Splits [begin, end) into at most max_threads() consecutive bands of at least
+// min_band elements and calls func(band_begin, band_end) for each of them. The
+// calling thread processes the first band and waits for the rest. Calls made
+// from within a band are executed serially.
+template<typename Func>
+void parallel_for(ptrdiff_t begin, ptrdiff_t end, ptrdiff_t min_band, Func&& func)
+{
+  detail::parallel_for_impl(begin, end, min_band, std::forward<Func>(func));
+}
+
+// Row-band variant of parallel_for for images of the given width.
+template<typename Func>
+void parallel_for_rows(ptrdiff_t height, ptrdiff_t width, Func&& func)
+{
+  const auto min_rows = width > 0 ? (detail::min_band_pixels + width - 1) / width : height;
+  parallel_for(0, height, min_rows, std::forward<Func>(func));
+}
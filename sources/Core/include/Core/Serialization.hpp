@@ -0,0 +1,28 @@
+#pragma once
+
+#include <Core/OpConfigDefines.hpp>
+
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Text description of an operation chain, one operation per line: its name followed
+// by key=value parameters, e.g.
+//
+//   filter method=fir radius_x=2 radius_y=2 sigma_x=1 sigma_y=1
+//   gradient type=abs
+//   threshold thresh=20 true=255 false=0
+//   canny lo=10 hi=30
+//   morph type=open radius_x=1 radius_y=1
+//
+// Empty lines and lines starting with '#' are skipped. Malformed descriptions throw
+// std::runtime_error naming the line.
+std::string op_config_to_string(OpConfig const& config);
+OpConfig parse_op_config(std::string const& line);
+
+void write_chain(std::ostream& stream, std::vector<OpConfig> const& chain);
+std::vector<OpConfig> read_chain(std::istream& stream);
+
+// Same as above, reading the file of the given name.
+std::vector<OpConfig> read_chain(std::string const& file_name);
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum class SimdLevel
+{
+  Scalar,
+  SSE2,
+  AVX2
+};
+
+// Caps the instruction set used by the vectorized kernels. By default the best
+// level supported by the CPU is used; the effective level is returned by simd_level().
+void set_max_simd_level(SimdLevel level);
+SimdLevel simd_level();
+
+namespace detail
+{
+  // Vectorized inner loops of filter_x/filter_y for float images, dispatched at
+  // runtime. They accumulate in the same order as the scalar templates, so the
+  // results are identical.
+
+  // Computes dst_row[j] for kernel_radius <= j < width - kernel_radius.
+  void filter_x_inner_row(float const* src_row, float const* kernel, ptrdiff_t kernel_sz,
+    ptrdiff_t width, float* dst_row);
+
+  // Computes the full dst_row from kernel_sz source rows, starting at src_rows
+  // and spaced src_stride elements apart.
+  void filter_y_inner_row(float const* src_rows, ptrdiff_t src_stride, float const* kernel,
+    ptrdiff_t kernel_sz, ptrdiff_t width, float* dst_row);
+
+  // Computes the 3x3 Sobel gradient magnitude (squared if requested) of the pixels
+  // 1 <= j < width - 1, and the gradients if grad_x_row and grad_y_row are not null.
+  void sobel_inner_row(float const* row_up, float const* row_mid, float const* row_down, ptrdiff_t width,
+    bool squared, float* magnitude_row, float* grad_x_row, float* grad_y_row);
+
+  // Computes the gradient direction bins (see gradient_direction_bin) of a row.
+  void gradient_direction_row(float const* grad_x_row, float const* grad_y_row, ptrdiff_t width, int8_t* dst_row);
+
+  // Packs src_row[x] >= threshold into the bits of dst_row (see BinaryImage).
+  void threshold_pack_row(float const* src_row, ptrdiff_t width, float threshold, uint64_t* dst_row);
+
+  // Display conversions, see to_display_gray and rgb32_to_gray.
+  void min_max_row(float const* src_row, ptrdiff_t width, float& min, float& max);
+  void display_gray_row(float const* src_row, ptrdiff_t width, float offset, float scale, uint8_t* dst_row);
+  void rgb32_average_row(uint32_t const* src_row, ptrdiff_t width, float* dst_row);
+}
@@ -0,0 +1,208 @@
+#include <Core/BinaryImage.hpp>
+
+#include <algorithm>
+#include <vector>
+
+namespace detail
+{
+  size_t popcount(uint64_t word)
+  {
+    word = word - ((word >> 1) & 0x5555555555555555ull);
+    word = (word & 0x3333333333333333ull) + ((word >> 2) & 0x3333333333333333ull);
+    word = (word + (word >> 4)) & 0x0f0f0f0f0f0f0f0full;
+    return size_t((word * 0x0101010101010101ull) >> 56);
+  }
+
+  ptrdiff_t words_per_row(ptrdiff_t w)
+  {
+    return (w + 63) / 64;
+  }
+
+  template<typename Op>
+  void binary_op(BinaryImage const& a, BinaryImage const& b, Op op, BinaryImage& dst)
+  {
+    if (dst.height() != a.height() || dst.width() != a.width())
+      dst.alloc(a.size());
+
+    const auto n = a.wordsPerRow();
+    parallel_for_rows(a.height(), a.width(), [&](ptrdiff_t row_begin, ptrdiff_t row_end)
+      {
+        for (ptrdiff_t i = row_begin; i < row_end; ++i)
+        {
+          const auto a_row = a.row(i);
+          const auto b_row = b.row(i);
+          const auto dst_row = dst.row(i);
+          for (ptrdiff_t k = 0; k < n; ++k)
+            dst_row[k] = op(a_row[k], b_row[k]);
+        }
+      });
+  }
+
+  // out[x] = in[x + shift] over n words, the bits past the end are those of fill.
+  void shift_bits_down(uint64_t const* in, ptrdiff_t n, ptrdiff_t shift, uint64_t fill, uint64_t* out)
+  {
+    const auto word_shift = shift / 64;
+    const auto bit_shift = shift % 64;
+    for (ptrdiff_t k = 0; k < n; ++k)
+    {
+      const auto lo = k + word_shift < n ? in[k + word_shift] : fill;
+      if (bit_shift == 0)
+      {
+        out[k] = lo;
+        continue;
+      }
+
+      const auto hi = k + word_shift + 1 < n ? in[k + word_shift + 1] : fill;
+      out[k] = (lo >> bit_shift) | (hi << (64 - bit_shift));
+    }
+  }
+
+  // Combines every pixel with its kernel_radius neighbours on both sides. The row is
+  // embedded between words of fill, the neutral element of op, and the window of
+  // width L is built from windows of width 1, 2, 4, ... < L, each one shift and op.
+  template<typename Op>
+  void binary_morph_x(BinaryImage const& src, ptrdiff_t kernel_radius, Op op, uint64_t fill, BinaryImage& dst)
+  {
+    const auto n_words = src.wordsPerRow();
+    const auto margin_words = (kernel_radius + 63) / 64;
+    const auto n = n_words + 2 * margin_words;
+    const auto kernel_sz = 2 * kernel_radius + 1;
+    const auto last_mask = src.lastWordMask();
+
+    parallel_for_rows(src.height(), src.width(), [&](ptrdiff_t row_begin, ptrdiff_t row_end)
+      {
+        std::vector<uint64_t> window(static_cast<size_t>(n), fill);
+        std::vector<uint64_t> shifted(static_cast<size_t>(n));
+        for (ptrdiff_t i = row_begin; i < row_end; ++i)
+        {
+          std::fill(window.begin(), window.end(), fill);
+          std::copy_n(src.row(i), n_words, window.begin() + margin_words);
+          if (n_words > 0)
+            window[margin_words + n_words - 1] |= fill & ~last_mask;
+
+          // window[x] combines the pixels [x, x + len).
+          ptrdiff_t len = 1;
+          while (2 * len <= kernel_sz)
+          {
+            shift_bits_down(window.data(), n, len, fill, shifted.data());
+            for (ptrdiff_t k = 0; k < n; ++k)
+              window[k] = op(window[k], shifted[k]);
+            len *= 2;
+          }
+
+          if (len < kernel_sz)
+          {
+            shift_bits_down(window.data(), n, kernel_sz - len, fill, shifted.data());
+            for (ptrdiff_t k = 0; k < n; ++k)
+              window[k] = op(window[k], shifted[k]);
+          }
+
+          // Center the windows on the pixels.
+          shift_bits_down(window.data(), n, 64 * margin_words - kernel_radius, fill, shifted.data());
+
+          const auto dst_row = dst.row(i);
+          std::copy_n(shifted.begin(), n_words, dst_row);
+          if (n_words > 0)
+            dst_row[n_words - 1] &= last_mask;
+        }
+      });
+  }
+
+  template<typename Op>
+  void binary_morph(BinaryImage const& src, ptrdiff_t kernel_radius_y, ptrdiff_t kernel_radius_x, Op op, uint64_t fill,
+    BinaryImage& dst)
+  {
+    BinaryImage tmp(src.size());
+    binary_morph_x(src, kernel_radius_x, op, fill, tmp);
+
+    if (dst.height() != src.height() || dst.width() != src.width())
+      dst.alloc(src.size());
+
+    // Clamping the rows leaves the borders unaffected, as op is idempotent.
+    morph_filter_y(tmp.words(), kernel_radius_y, BorderCondition::BC_CLAMP, op, dst.words());
+  }
+}
+
+BinaryImage::BinaryImage(ptrdiff_t h, ptrdiff_t w)
+{
+  alloc(h, w);
+}
+
+BinaryImage::BinaryImage(Position const& sz) : BinaryImage(sz.y, sz.x) {}
+
+void BinaryImage::alloc(ptrdiff_t h, ptrdiff_t w)
+{
+  w_ = w;
+  words_.alloc(h, detail::words_per_row(w));
+}
+
+void BinaryImage::alloc(Position const& sz)
+{
+  alloc(sz.y, sz.x);
+}
+
+void BinaryImage::fill(bool value)
+{
+  const auto n = wordsPerRow();
+  const auto word = value ? ~uint64_t(0) : uint64_t(0);
+  for (ptrdiff_t i = 0; i < height(); ++i)
+  {
+    std::fill_n(row(i), n, word);
+    if (n > 0)
+      row(i)[n - 1] &= lastWordMask();
+  }
+}
+
+size_t BinaryImage::count() const
+{
+  size_t n_set = 0;
+  for (ptrdiff_t i = 0; i < height(); ++i)
+    for (ptrdiff_t k = 0; k < wordsPerRow(); ++k)
+      n_set += detail::popcount(row(i)[k]);
+
+  return n_set;
+}
+
+uint64_t BinaryImage::lastWordMask() const
+{
+  const auto bits = w_ % 64;
+  return bits == 0 ? ~uint64_t(0) : (uint64_t(1) << bits) - 1;
+}
+
+void binary_and(BinaryImage const& a, BinaryImage const& b, BinaryImage& dst)
+{
+  detail::binary_op(a, b, [](uint64_t x, uint64_t y) { return x & y; }, dst);
+}
+
+void binary_or(BinaryImage const& a, BinaryImage const& b, BinaryImage& dst)
+{
+  detail::binary_op(a, b, [](uint64_t x, uint64_t y) { return x | y; }, dst);
+}
+
+void binary_xor(BinaryImage const& a, BinaryImage const& b, BinaryImage& dst)
+{
+  detail::binary_op(a, b, [](uint64_t x, uint64_t y) { return x ^ y; }, dst);
+}
+
+void binary_not(BinaryImage const& src, BinaryImage& dst)
+{
+  detail::binary_op(src, src, [](uint64_t x, uint64_t) { return ~x; }, dst);
+
+  // Keep the bits past the width cleared.
+  const auto n = dst.wordsPerRow();
+  if (n > 0)
+    for (ptrdiff_t i = 0; i < dst.height(); ++i)
+      dst.row(i)[n - 1] &= dst.lastWordMask();
+}
+
+void erode(BinaryImage const& src, ptrdiff_t kernel_radius_y, ptrdiff_t kernel_radius_x, BinaryImage& dst)
+{
+  detail::binary_morph(src, kernel_radius_y, kernel_radius_x,
+    [](uint64_t x, uint64_t y) { return x & y; }, ~uint64_t(0), dst);
+}
+
+void dilate(BinaryImage const& src, ptrdiff_t kernel_radius_y, ptrdiff_t kernel_radius_x, BinaryImage& dst)
+{
+  detail::binary_morph(src, kernel_radius_y, kernel_radius_x,
+    [](uint64_t x, uint64_t y) { return x | y; }, uint64_t(0), dst);
+}
@@ -1,15 +1,78 @@
 #include <Core/Core.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iterator>
+#include <optional>
 #include <vector>
 #include <utility>
 
 namespace detail
 {
+  // Target size of the strip buffers of the fused chain execution.
+  constexpr ptrdiff_t fused_strip_bytes = ptrdiff_t(1) << 19;
+
   bool is_in_range(ptrdiff_t i, ptrdiff_t lo, ptrdiff_t hi)
   {
     return i >= lo && i < hi;
   }
 
+  ptrdiff_t border_index(ptrdiff_t k, ptrdiff_t n, BorderCondition bc)
+  {
+    if (k >= 0 && k < n)
+      return k;
+
+    switch (bc)
+    {
+    case BorderCondition::BC_ZERO:
+      return -1;
+    case BorderCondition::BC_CLAMP:
+      return k < 0 ? 0 : n - 1;
+    case BorderCondition::BC_WRAP:
+    default:
+      return (k % n + n) % n;
+    }
+  }
+
+  RecursiveGaussCoefficients recursive_gauss_coefficients(double sigma)
+  {
+    // Young and van Vliet, "Recursive implementation of the Gaussian filter", 1995.
+    // The fit of q is not valid below sigma = 0.5.
+    sigma = std::max(sigma, 0.5);
+    const double q = sigma >= 2.5 ?
+      0.98711 * sigma - 0.96330 :
+      3.97156 - 4.14554 * std::sqrt(1.0 - 0.26891 * sigma);
+
+    const double q2 = q * q;
+    const double q3 = q2 * q;
+    const double b0 = 1.57825 + 2.44413 * q + 1.4281 * q2 + 0.422205 * q3;
+    const double a1 = (2.44413 * q + 2.85619 * q2 + 1.26661 * q3) / b0;
+    const double a2 = -(1.4281 * q2 + 1.26661 * q3) / b0;
+    const double a3 = 0.422205 * q3 / b0;
+
+    RecursiveGaussCoefficients c;
+    c.gain = 1.0 - (a1 + a2 + a3);
+    c.a[0] = a1;
+    c.a[1] = a2;
+    c.a[2] = a3;
+
+    // Triggs and Sdika, "Boundary conditions for Young-van Vliet recursive filtering", 2006.
+    const double f = 1.0 / ((1.0 + a1 - a2 + a3) * (1.0 - a1 - a2 - a3) * (1.0 + a2 + (a1 - a3) * a3));
+    c.right_border[0][0] = f * (-a3 * a1 + 1.0 - a3 * a3 - a2);
+    c.right_border[0][1] = f * (a3 + a1) * (a2 + a3 * a1);
+    c.right_border[0][2] = f * a3 * (a1 + a3 * a2);
+    c.right_border[1][0] = f * (a1 + a3 * a2);
+    c.right_border[1][1] = -f * (a2 - 1.0) * (a2 + a3 * a1);
+    c.right_border[1][2] = -f * (a3 * a1 + a3 * a3 + a2 - 1.0) * a3;
+    c.right_border[2][0] = f * (a3 * a1 + a2 + a1 * a1 - a2 * a2);
+    c.right_border[2][1] = f * (a1 * a2 + a3 * a2 * a2 - a1 * a3 * a3 - a3 * a3 * a3 - a3 * a2 + a3);
+    c.right_border[2][2] = f * a3 * (a1 + a3 * a2);
+
+    return c;
+  }
+
   ptrdiff_t clamp_index(ptrdiff_t index, ptrdiff_t size)
   {
     return index < 0 ? 0 : (index >= size ? size - 1 : index);
@@ -26,45 +89,296 @@ namespace detail
     return static_cast<int8_t>(angle / bin_width);
   }
 
-  void track_edge_hysteresis_impl(Image2d<unsigned char>& dst, Position start)
+  void hysteresis_edge_tracking_serial(ImageView<unsigned char> dst)
   {
     const auto w = dst.width();
     const auto h = dst.height();
 
-    const std::vector<Position> moore_neighbors = {
-      Position(-1, -1), Position(-1, 0), Position(-1, 1), Position(0, 1),
-      Position(1, 1), Position(1, 0), Position(1, -1), Position(0, -1) };
+    // Copy into a zero-padded buffer, so that the neighbours never need bounds checks.
+    ScratchImage<unsigned char> padded(h + 2, w + 2);
+    fill(padded.view(), 0);
+    fill(padded.view().roi(1, 1, h, w), dst);
+
+    const auto stride = padded.view().stride();
+    const ptrdiff_t moore_neighbors[] = {
+      -stride - 1, -stride, -stride + 1, 1, stride + 1, stride, stride - 1, -1 };
+
+    std::vector<ptrdiff_t> stack;
+    unsigned char* const data = padded.view().data();
+    for (ptrdiff_t i = 1; i <= h; ++i)
+      for (ptrdiff_t j = 1; j <= w; ++j)
+      {
+        const auto start = i * stride + j;
+        if (data[start] != 2)
+          continue;
+
+        data[start] = 255;
+        stack.push_back(start);
+        while (!stack.empty())
+        {
+          const auto curr = stack.back();
+          stack.pop_back();
+
+          for (const auto nbh : moore_neighbors)
+          {
+            const auto nbh_index = curr + nbh;
+            if (data[nbh_index] == 1)
+            {
+              data[nbh_index] = 255;
+              stack.push_back(nbh_index);
+            }
+          }
+        }
+      }
+
+    fill(dst, padded.view().roi(1, 1, h, w));
+  }
+
+  // Union-find forest over the pixel indices y * w + x. Roots are the smallest index of
+  // their set and carry whether the set contains a strong pixel.
+  class EdgeForest
+  {
+  public:
+    EdgeForest(ptrdiff_t h, ptrdiff_t w) : parent_(1, h * w), strong_(1, h * w) {}
+
+    int32_t* parent() { return parent_.view().data(); }
+    unsigned char* strong() { return strong_.view().data(); }
+
+    int32_t find(int32_t i)
+    {
+      auto p = parent();
+      while (p[i] != i)
+      {
+        p[i] = p[p[i]];
+        i = p[i];
+      }
+      return i;
+    }
+
+    // Does not compress the paths, so it can be called concurrently once the forest is built.
+    int32_t findRoot(int32_t i) const
+    {
+      auto p = parent_.view().data();
+      while (p[i] != i)
+        i = p[i];
+      return i;
+    }
+
+    void unite(int32_t a, int32_t b)
+    {
+      a = find(a);
+      b = find(b);
+      if (a == b)
+        return;
+
+      if (b < a)
+        std::swap(a, b);
+
+      parent()[b] = a;
+      strong()[a] |= strong()[b];
+    }
+
+    bool isStrong(int32_t root) const { return strong_.view().data()[root] != 0; }
+
+  private:
+    ScratchImage<int32_t> parent_;
+    ScratchImage<unsigned char> strong_;
+  };
+
+  void hysteresis_edge_tracking_parallel(ImageView<unsigned char> dst, ptrdiff_t n_bands)
+  {
+    const auto w = dst.width();
+    const auto h = dst.height();
+
+    // The forest indexes the pixels with 32 bits.
+    if (h * w > ptrdiff_t(std::numeric_limits<int32_t>::max()))
+    {
+      hysteresis_edge_tracking_serial(dst);
+      return;
+    }
+
+    n_bands = std::clamp<ptrdiff_t>(n_bands, 1, std::max<ptrdiff_t>(h, 1));
 
-    std::vector<Position> hysteresis = { start };
-    while (!hysteresis.empty())
+    EdgeForest forest(h, w);
+    const auto band_begin = [&](ptrdiff_t band) { return band * h / n_bands; };
+
+    // Connect the edge pixels within each band. The bands only touch their own part of the forest.
+    const auto connect = [&](ptrdiff_t i, ptrdiff_t j, ptrdiff_t i_nbh, ptrdiff_t j_nbh)
     {
-      const auto curr = hysteresis.back();
-      hysteresis.pop_back();
+      if (j_nbh >= 0 && j_nbh < w && dst(i_nbh, j_nbh) != 0)
+        forest.unite(int32_t(i * w + j), int32_t(i_nbh * w + j_nbh));
+    };
 
-      for (const auto nbh : moore_neighbors)
+    parallel_for(0, n_bands, 1, [&](ptrdiff_t first_band, ptrdiff_t last_band)
       {
-        const auto nbh_pos = curr + nbh;
-        if (dst.isValid(nbh_pos) && dst(nbh_pos) == 1)
+        for (ptrdiff_t band = first_band; band < last_band; ++band)
         {
-          dst(nbh_pos) = 255;
-          hysteresis.push_back(nbh_pos);
+          const auto row_begin = band_begin(band);
+          const auto row_end = band_begin(band + 1);
+          for (ptrdiff_t i = row_begin; i < row_end; ++i)
+          {
+            const auto row = dst.row(i);
+            const auto parent = forest.parent() + i * w;
+            const auto strong = forest.strong() + i * w;
+            for (ptrdiff_t j = 0; j < w; ++j)
+            {
+              parent[j] = int32_t(i * w + j);
+              strong[j] = row[j] == 2;
+              if (row[j] == 0)
+                continue;
+
+              connect(i, j, i, j - 1);
+              if (i > row_begin)
+              {
+                connect(i, j, i - 1, j - 1);
+                connect(i, j, i - 1, j);
+                connect(i, j, i - 1, j + 1);
+              }
+            }
+          }
         }
+      });
+
+    // A cancelled loop leaves parts of the forest uninitialized, which must not be merged.
+    if (cancellation_requested())
+      return;
+
+    // Merge the sets across the band borders.
+    for (ptrdiff_t band = 1; band < n_bands; ++band)
+    {
+      const auto i = band_begin(band);
+      if (i == 0 || i >= h)
+        continue;
+
+      const auto row = dst.row(i);
+      for (ptrdiff_t j = 0; j < w; ++j)
+      {
+        if (row[j] == 0)
+          continue;
+
+        connect(i, j, i - 1, j - 1);
+        connect(i, j, i - 1, j);
+        connect(i, j, i - 1, j + 1);
       }
     }
+
+    // Edge pixels connected to a strong pixel are kept, weak ones stay 1.
+    parallel_for_rows(h, w, [&](ptrdiff_t row_begin, ptrdiff_t row_end)
+      {
+        for (ptrdiff_t i = row_begin; i < row_end; ++i)
+        {
+          const auto row = dst.row(i);
+          for (ptrdiff_t j = 0; j < w; ++j)
+            if (row[j] != 0)
+              row[j] = forest.isStrong(forest.findRoot(int32_t(i * w + j))) ? 255 : 1;
+        }
+      });
+  }
+
+  void hysteresis_edge_tracking(ImageView<unsigned char> dst)
+  {
+    const auto min_rows = dst.width() > 0 ? (min_band_pixels + dst.width() - 1) / dst.width() : dst.height();
+    const auto n_bands = std::min<ptrdiff_t>(ptrdiff_t(max_threads()), dst.height() / std::max<ptrdiff_t>(min_rows, 1));
+    if (n_bands > 1)
+      hysteresis_edge_tracking_parallel(dst, n_bands);
+    else
+      hysteresis_edge_tracking_serial(dst);
   }
 
-  void hysteresis_edge_tracking(Image2d<unsigned char>& dst)
+  // Scratch image whose pixel type is chosen when it is used, there is one buffer per type.
+  class AnyScratchImage
   {
-    foreach2d(dst, y, x)
+  public:
+    explicit AnyScratchImage(Position const& sz) : size_(sz) {}
+
+    AnyImageView view(PixelType type)
     {
-      const auto pos = Position(y, x);
-      const auto val = dst(pos);
-      if (val == 2)
+      switch (type)
       {
-        dst(pos) = 255;
-        track_edge_hysteresis_impl(dst, pos);
+      case PixelType::U8:
+        return viewOf(u8_);
+      case PixelType::U16:
+        return viewOf(u16_);
+      default:
+        return viewOf(f32_);
       }
     }
+
+  private:
+    template<typename T>
+    ImageView<T> viewOf(std::optional<ScratchImage<T>>& img)
+    {
+      if (!img)
+        img.emplace(size_);
+
+      return img->view();
+    }
+
+    Position size_;
+    std::optional<ScratchImage<unsigned char>> u8_;
+    std::optional<ScratchImage<uint16_t>> u16_;
+    std::optional<ScratchImage<float>> f32_;
+  };
+
+  template<typename View>
+  View rows(View const& img, ptrdiff_t y_begin, ptrdiff_t y_end)
+  {
+    return std::visit([&](auto const& view) -> View { return view.rows(y_begin, y_end); }, img);
+  }
+
+  // Reallocates img unless it already has the given type and size.
+  void fit_image(AnyImage& img, PixelType type, Position const& sz)
+  {
+    const auto size = image_size(any_view(std::as_const(img)));
+    if (pixel_type(img) == type && size.y == sz.y && size.x == sz.x)
+      return;
+
+    switch (type)
+    {
+    case PixelType::U8:
+      img = Image2d<unsigned char>(sz, no_init);
+      break;
+    case PixelType::U16:
+      img = Image2d<uint16_t>(sz, no_init);
+      break;
+    default:
+      img = Image2d<float>(sz, no_init);
+      break;
+    }
+  }
+
+  // Scratch images of an execution on images of one size: the two intermediate results
+  // and the converted input of a stage.
+  struct ChainScratch
+  {
+    explicit ChainScratch(Position const& sz) :
+      tmps{ AnyScratchImage(sz), AnyScratchImage(sz) }, converted(sz), size(sz) {}
+
+    AnyScratchImage tmps[2];
+    AnyScratchImage converted;
+    Position size;
+  };
+
+  // Performs op on in, converted first if the operation reads another pixel type. The
+  // conversion uses the given scratch image of the input's size, or a temporary one.
+  void perform_converted(Operation const& op, AnyConstImageView const& in, AnyImageView const& out,
+    AnyScratchImage* converted)
+  {
+    const auto in_type = pixel_type(in);
+    const auto op_type = op.inputType(in_type);
+    if (op_type == in_type)
+    {
+      op.perform(in, out);
+      return;
+    }
+
+    std::optional<AnyScratchImage> tmp;
+    if (!converted)
+      converted = &tmp.emplace(image_size(in));
+
+    const auto converted_view = converted->view(op_type);
+    convert_image(in, converted_view);
+    op.perform(const_view(converted_view), out);
   }
 
   struct OpCreator
@@ -88,28 +402,208 @@ namespace detail
     {
       return std::make_unique<CannyOp>(config);
     }
+
+    std::unique_ptr<Operation> operator()(MorphConfig const& config)
+    {
+      return std::make_unique<MorphOp>(config);
+    }
   };
 }
 
+PixelType pixel_type(AnyConstImageView const& img)
+{
+  return PixelType(img.index());
+}
+
+PixelType pixel_type(AnyImageView const& img)
+{
+  return PixelType(img.index());
+}
+
+PixelType pixel_type(AnyImage const& img)
+{
+  return PixelType(img.index());
+}
+
+Position image_size(AnyConstImageView const& img)
+{
+  return std::visit([](auto const& view) { return view.size(); }, img);
+}
+
+AnyConstImageView const_view(AnyImageView const& img)
+{
+  return std::visit([](auto const& view) -> AnyConstImageView { return view; }, img);
+}
+
+AnyImageView any_view(AnyImage& img)
+{
+  return std::visit([](auto& image) -> AnyImageView { return image.view(); }, img);
+}
+
+AnyConstImageView any_view(AnyImage const& img)
+{
+  return std::visit([](auto const& image) -> AnyConstImageView { return image.view(); }, img);
+}
+
+void convert_image(AnyConstImageView const& src, AnyImageView const& dst)
+{
+  std::visit([](auto const& src_view, auto const& dst_view) { convert_image(src_view, dst_view); }, src, dst);
+}
+
+void to_display_gray(ConstImageView<float> src, float lo, float hi, ImageView<unsigned char> dst)
+{
+  const auto scale = hi > lo ? 254.f / (hi - lo) : 0.f;
+  parallel_for_rows(src.height(), src.width(), [&](ptrdiff_t row_begin, ptrdiff_t row_end)
+    {
+      for (ptrdiff_t i = row_begin; i < row_end; ++i)
+        detail::display_gray_row(src.row(i), src.width(), lo, scale, dst.row(i));
+    });
+}
+
+void rgb32_to_gray(ConstImageView<uint32_t> src, ImageView<float> dst)
+{
+  parallel_for_rows(src.height(), src.width(), [&](ptrdiff_t row_begin, ptrdiff_t row_end)
+    {
+      for (ptrdiff_t i = row_begin; i < row_end; ++i)
+        detail::rgb32_average_row(src.row(i), src.width(), dst.row(i));
+    });
+}
+
+GaussPyramid::GaussPyramid(ConstImageView<float> src, size_t n_levels)
+{
+  build(src, n_levels);
+}
+
+void GaussPyramid::build(ConstImageView<float> src, size_t n_levels)
+{
+  src_ = src;
+
+  size_t n_reduced = 0;
+  for (auto sz = src.size(); n_reduced + 1 < n_levels && (sz.y > 1 || sz.x > 1); sz = pyr_down_size(sz))
+    ++n_reduced;
+
+  levels_.resize(n_reduced);
+
+  // Every level depends on the previous one, the rows of each level are reduced in parallel.
+  ConstImageView<float> prev = src;
+  for (auto& level : levels_)
+  {
+    const auto sz = pyr_down_size(prev.size());
+    if (level.height() != sz.y || level.width() != sz.x)
+      level.allocUninitialized(sz);
+
+    pyr_down<float>(prev, level.view());
+    prev = level.view();
+  }
+}
+
+size_t GaussPyramid::levels() const
+{
+  return levels_.size() + 1;
+}
+
+ConstImageView<float> GaussPyramid::level(size_t i) const
+{
+  return i == 0 ? src_ : levels_.at(i - 1).view();
+}
+
 ThresholdOp::ThresholdOp(ThresholdConfig const& config) : config_(config) {}
 
-void ThresholdOp::perform(Image2d<float> const& in, Image2d<float>& out) const
+PixelType ThresholdOp::outputType(PixelType) const
 {
-  threshold_image(in, config_.thresh, config_.true_val, config_.false_val, out);
+  const auto fits = [this](float max_val)
+  {
+    const auto is_pixel = [max_val](float val) { return val >= 0.f && val <= max_val && val == std::floor(val); };
+    return is_pixel(config_.true_val) && is_pixel(config_.false_val);
+  };
+
+  if (fits(255.f))
+    return PixelType::U8;
+
+  if (fits(65535.f))
+    return PixelType::U16;
+
+  return PixelType::F32;
+}
+
+void ThresholdOp::perform(AnyConstImageView const& in, AnyImageView const& out) const
+{
+  std::visit([this](auto const& src, auto const& dst)
+    {
+      using U = typename std::decay_t<decltype(dst)>::value_type;
+      const auto true_val = static_cast<U>(config_.true_val);
+      const auto false_val = static_cast<U>(config_.false_val);
+
+      // Integer pixels are compared as float, as the threshold may have a fraction.
+      parallel_for_rows(src.height(), src.width(), [&](ptrdiff_t row_begin, ptrdiff_t row_end)
+        {
+          for (ptrdiff_t i = row_begin; i < row_end; ++i)
+          {
+            const auto src_row = src.row(i);
+            const auto dst_row = dst.row(i);
+            for (ptrdiff_t j = 0; j < src.width(); ++j)
+              dst_row[j] = float(src_row[j]) >= config_.thresh ? true_val : false_val;
+          }
+        });
+    }, in, out);
+}
+
+std::optional<ptrdiff_t> ThresholdOp::haloRows() const
+{
+  return 0;
 }
 
 FilterOp::FilterOp(FilterConfig const& config) : config_(config) {}
 
-void FilterOp::perform(Image2d<float> const& in, Image2d<float>& out) const
+PixelType FilterOp::inputType(PixelType) const
 {
+  return PixelType::F32;
+}
+
+PixelType FilterOp::outputType(PixelType) const
+{
+  return PixelType::F32;
+}
+
+void FilterOp::perform(AnyConstImageView const& in_any, AnyImageView const& out_any) const
+{
+  const auto in = std::get<ImageView<float const>>(in_any);
+  const auto out = std::get<ImageView<float>>(out_any);
+  if (config_.method == FilterConfig::Method::IIR)
+  {
+    gauss_filter_iir(in, config_.sigma_y, config_.sigma_x, out);
+    return;
+  }
+
   gauss_filter(in, config_.kernel_radius_y, config_.kernel_radius_x, 
     config_.sigma_y, config_.sigma_x, BorderCondition::BC_CLAMP, out);
 }
 
+std::optional<ptrdiff_t> FilterOp::haloRows() const
+{
+  // The recursive filter has an unbounded support.
+  if (config_.method == FilterConfig::Method::IIR)
+    return std::nullopt;
+
+  return config_.kernel_radius_y;
+}
+
 GradOp::GradOp(GradConfig const& config) : config_(config) {}
 
-void GradOp::perform(Image2d<float> const& in, Image2d<float>& out) const
+PixelType GradOp::inputType(PixelType) const
+{
+  return PixelType::F32;
+}
+
+PixelType GradOp::outputType(PixelType) const
+{
+  return PixelType::F32;
+}
+
+void GradOp::perform(AnyConstImageView const& in_any, AnyImageView const& out_any) const
 {
+  const auto in = std::get<ImageView<float const>>(in_any);
+  const auto out = std::get<ImageView<float>>(out_any);
   switch (config_.type)
   {
   case GradConfig::GradType::GradX:
@@ -134,29 +628,164 @@ void GradOp::perform(Image2d<float> const& in, Image2d<float>& out) const
   }
 }
 
+std::optional<ptrdiff_t> GradOp::haloRows() const
+{
+  // All gradients use the 3x3 Sobel operator.
+  return 1;
+}
+
 CannyOp::CannyOp(CannyConfig const& config) : config_(config) {}
 
-void CannyOp::perform(Image2d<float> const& in, Image2d<float>& out) const
+PixelType CannyOp::inputType(PixelType) const
 {
-  Image2d<unsigned char> canny_mask(out.size());
-  canny_edge_detection(in, config_.lo_thresh, config_.hi_thresh, canny_mask);
+  return PixelType::F32;
+}
 
-  fill(out, canny_mask);
+PixelType CannyOp::outputType(PixelType) const
+{
+  return PixelType::U8;
+}
+
+void CannyOp::perform(AnyConstImageView const& in, AnyImageView const& out) const
+{
+  canny_edge_detection(std::get<ImageView<float const>>(in), config_.lo_thresh, config_.hi_thresh,
+    std::get<ImageView<unsigned char>>(out));
+}
+
+MorphOp::MorphOp(MorphConfig const& config) : config_(config) {}
+
+void MorphOp::perform(AnyConstImageView const& in_any, AnyImageView const& out_any) const
+{
+  // The minimum and maximum filters work on every pixel type.
+  std::visit([&](auto const& in)
+    {
+      using T = typename std::decay_t<decltype(in)>::value_type;
+      const auto out = std::get<ImageView<T>>(out_any);
+
+      const auto ry = config_.kernel_radius_y;
+      const auto rx = config_.kernel_radius_x;
+      switch (config_.type)
+      {
+      case MorphConfig::MorphType::Erode:
+      {
+        erode(in, ry, rx, BorderCondition::BC_CLAMP, out);
+      }
+      break;
+      case MorphConfig::MorphType::Dilate:
+      {
+        dilate(in, ry, rx, BorderCondition::BC_CLAMP, out);
+      }
+      break;
+      case MorphConfig::MorphType::Open:
+      {
+        morph_open(in, ry, rx, BorderCondition::BC_CLAMP, out);
+      }
+      break;
+      case MorphConfig::MorphType::Close:
+      {
+        morph_close(in, ry, rx, BorderCondition::BC_CLAMP, out);
+      }
+      break;
+      default:
+      {
+      break;
+      }
+      }
+    }, in_any);
+}
+
+std::optional<ptrdiff_t> MorphOp::haloRows() const
+{
+  // Opening and closing apply two filters.
+  const bool composed = config_.type == MorphConfig::MorphType::Open || config_.type == MorphConfig::MorphType::Close;
+  return composed ? 2 * config_.kernel_radius_y : config_.kernel_radius_y;
+}
+
+void OperationChain::setExecutionMode(ExecutionMode mode)
+{
+  mode_ = mode;
+}
+
+ExecutionMode OperationChain::executionMode() const
+{
+  return mode_;
+}
+
+void OperationChain::setStripRows(ptrdiff_t rows)
+{
+  strip_rows_ = rows;
+}
+
+void OperationChain::setProfiling(bool enabled)
+{
+  profiling_ = enabled;
+  if (!profiling_)
+  {
+    std::lock_guard<std::mutex> lock(profile_mutex_);
+    profile_.clear();
+  }
+}
+
+bool OperationChain::profiling() const
+{
+  return profiling_;
+}
+
+std::vector<OpProfile> OperationChain::profile() const
+{
+  std::lock_guard<std::mutex> lock(profile_mutex_);
+  return profile_;
+}
+
+void OperationChain::setCaching(bool enabled)
+{
+  std::lock_guard<std::mutex> lock(cache_mutex_);
+  caching_ = enabled;
+  if (!caching_)
+  {
+    // Release the cached results.
+    for (auto& stage : chain_)
+      stage.result = AnyImage();
+
+    cached_stages_ = 0;
+  }
+}
+
+bool OperationChain::caching() const
+{
+  return caching_;
+}
+
+void OperationChain::invalidateCache()
+{
+  invalidateFrom(0);
+}
+
+void OperationChain::invalidateFrom(size_t stage_index)
+{
+  std::lock_guard<std::mutex> lock(cache_mutex_);
+  cached_stages_ = std::min(cached_stages_, stage_index);
 }
 
 void OperationChain::addOperation(int op_id, OpConfig const& config)
 {
-  chain_.emplace_back(op_id, std::visit(detail::OpCreator{}, config));
+  chain_.push_back(Stage{ op_id, config, std::visit(detail::OpCreator{}, config), AnyImage() });
 }
 
 void OperationChain::modifyOperation(int op_id, OpConfig const& config)
 {
   if (auto op_it = std::find_if(chain_.begin(), chain_.end(), [op_id](auto const& el) 
     {
-      return el.first == op_id;
+      return el.id == op_id;
     }); op_it != chain_.end())
   {
-    op_it->second = std::visit(detail::OpCreator{}, config);
+    if (op_it->config == config)
+      return;
+
+    invalidateFrom(size_t(op_it - chain_.begin()));
+
+    op_it->config = config;
+    op_it->op = std::visit(detail::OpCreator{}, config);
   }
 }
 
@@ -164,36 +793,411 @@ void OperationChain::removeOperation(int op_id)
 {
   if (auto op_it = std::find_if(chain_.begin(), chain_.end(), [op_id](auto const& el)
     {
-      return el.first == op_id;
+      return el.id == op_id;
     }); op_it != chain_.end())
   {
+    invalidateFrom(size_t(op_it - chain_.begin()));
+
     chain_.erase(op_it);
   }
 }
 
-void OperationChain::executeChain(Image2d<float> const& in, Image2d<float>& out) const
+PixelType OperationChain::outputType(PixelType in) const
+{
+  auto type = in;
+  for (auto const& stage : chain_)
+    type = stage.op->outputType(stage.op->inputType(type));
+
+  return type;
+}
+
+void ExecutionControl::cancel()
+{
+  cancelled_ = true;
+}
+
+bool ExecutionControl::isCancelled() const
 {
+  return cancelled_;
+}
+
+void ExecutionControl::setProgressCallback(std::function<void(size_t, size_t)> callback)
+{
+  progress_callback_ = std::move(callback);
+}
+
+void ExecutionControl::reportProgress(size_t done, size_t total) const
+{
+  if (progress_callback_)
+    progress_callback_(done, total);
+}
+
+void OperationChain::executeChain(AnyConstImageView const& in, AnyImageView const& out) const
+{
+  execute(in, out, nullptr);
+}
+
+bool OperationChain::executeChain(AnyConstImageView const& in, AnyImageView const& out, ExecutionControl const& control) const
+{
+  return execute(in, out, &control);
+}
+
+bool OperationChain::executeChain(Image2d<float> const& in, Image2d<float>& out, ExecutionControl const& control) const
+{
+  if (out.height() != in.height() || out.width() != in.width())
+  {
+    out.allocUninitialized(in.size());
+  }
+
+  return execute(in.view(), out.view(), &control);
+}
+
+bool OperationChain::execute(AnyConstImageView const& in, AnyImageView const& out, ExecutionControl const* control) const
+{
+  std::optional<std::vector<OpProfile>> profile;
+  if (profiling_)
+  {
+    profile.emplace();
+    profile->reserve(chain_.size());
+  }
+
+  const auto publish_profile = [&]()
+  {
+    if (!profile)
+      return;
+
+    std::lock_guard<std::mutex> lock(profile_mutex_);
+    profile_ = std::move(*profile);
+  };
+
   if (chain_.size() == 0)
   {
-    fill(out, in);
+    convert_image(in, out);
+    publish_profile();
+    return true;
   }
-  else if (chain_.size() == 1)
+
+  // Operations stop between row bands once cancelled, their output is discarded then.
+  std::optional<CancellationScope> cancellation;
+  if (control)
+    cancellation.emplace(control->cancelled_);
+
+  bool finished = false;
+  if (caching_)
   {
-    chain_.front().second->perform(in, out);
+    finished = executeCached(in, out, profile ? &*profile : nullptr, control);
   }
   else
   {
-    Image2d<float> tmp1(in.size());
-    fill(tmp1, in);
+    detail::ChainScratch scratch(image_size(in));
+    finished = executeUncached(in, out, scratch, profile ? &*profile : nullptr, control);
+  }
+
+  if (finished)
+    publish_profile();
+
+  return finished;
+}
+
+bool OperationChain::executeUncached(AnyConstImageView const& in, AnyImageView const& out, detail::ChainScratch& scratch,
+  std::vector<OpProfile>* profile, ExecutionControl const* control) const
+{
+  if (chain_.size() == 0)
+  {
+    convert_image(in, out);
+    return true;
+  }
+
+  // The first operation reads the input directly and the last one writes directly 
+  // to the output if it has the result's type, the intermediate results ping-pong
+  // between two scratch images.
+  size_t next_tmp = 0;
+
+  AnyConstImageView stage_in = in;
+  auto op_it = chain_.cbegin();
+  while (op_it != chain_.cend())
+  {
+    if (control && control->isCancelled())
+      return false;
+
+    // In the fused mode, group the consecutive operations that can run on strips.
+    auto group_end = std::next(op_it);
+    if (mode_ == ExecutionMode::Fused && !profile && op_it->op->haloRows())
+    {
+      while (group_end != chain_.cend() && group_end->op->haloRows())
+        ++group_end;
+    }
+
+    auto stage_type = pixel_type(stage_in);
+    for (auto it = op_it; it != group_end; ++it)
+      stage_type = it->op->outputType(it->op->inputType(stage_type));
+
+    AnyImageView stage_out = out;
+    if (group_end != chain_.cend() || stage_type != pixel_type(out))
+    {
+      stage_out = scratch.tmps[next_tmp].view(stage_type);
+      next_tmp = 1 - next_tmp;
+    }
+
+    if (std::distance(op_it, group_end) > 1)
+    {
+      if (!executeFused(op_it, group_end, stage_in, stage_out, control))
+        return false;
+    }
+    else
+    {
+      performStage(*op_it, stage_in, stage_out, &scratch.converted, profile);
+      if (control && control->isCancelled())
+        return false;
+    }
+
+    stage_in = const_view(stage_out);
+    op_it = group_end;
+
+    if (control)
+      control->reportProgress(size_t(op_it - chain_.cbegin()), chain_.size());
+  }
+
+  if (pixel_type(stage_in) != pixel_type(out))
+    convert_image(stage_in, out);
+
+  return !(control && control->isCancelled());
+}
+
+void OperationChain::executeBatch(std::vector<AnyConstImageView> const& in, std::vector<AnyImageView> const& out) const
+{
+  const auto n_images = ptrdiff_t(std::min(in.size(), out.size()));
+  const auto n_workers = std::min<ptrdiff_t>(ptrdiff_t(max_threads()), n_images);
+
+  // Every band of the parallel loop is one worker, which takes the next image until
+  // none are left, so that images of different sizes balance out.
+  std::atomic<ptrdiff_t> next_image{ 0 };
+  parallel_for(0, n_workers, 1, [&](ptrdiff_t worker_begin, ptrdiff_t worker_end)
+    {
+      std::optional<detail::ChainScratch> scratch;
+      for (auto worker = worker_begin; worker < worker_end; ++worker)
+      {
+        for (auto i = next_image++; i < n_images; i = next_image++)
+        {
+          const auto size = image_size(in[size_t(i)]);
+          if (!scratch || scratch->size.y != size.y || scratch->size.x != size.x)
+            scratch.emplace(size);
+
+          executeUncached(in[size_t(i)], out[size_t(i)], *scratch, nullptr, nullptr);
+        }
+      }
+    });
+}
+
+void OperationChain::executeBatch(std::vector<Image2d<float>> const& in, std::vector<Image2d<float>>& out) const
+{
+  out.resize(in.size());
+
+  std::vector<AnyConstImageView> in_views;
+  std::vector<AnyImageView> out_views;
+  in_views.reserve(in.size());
+  out_views.reserve(in.size());
+  for (size_t i = 0; i < in.size(); ++i)
+  {
+    if (out[i].height() != in[i].height() || out[i].width() != in[i].width())
+    {
+      out[i].allocUninitialized(in[i].size());
+    }
+
+    in_views.push_back(in[i].view());
+    out_views.push_back(out[i].view());
+  }
+
+  executeBatch(in_views, out_views);
+}
+
+void OperationChain::executeChain(Image2d<float> const& in, Image2d<float>& out) const
+{
+  if (out.height() != in.height() || out.width() != in.width())
+  {
+    out.allocUninitialized(in.size());
+  }
+
+  executeChain(in.view(), out.view());
+}
+
+void OperationChain::executeChain(GaussPyramid const& pyramid, size_t level, AnyImageView const& out) const
+{
+  executeChain(pyramid.level(level), out);
+}
+
+void OperationChain::executeChain(GaussPyramid const& pyramid, size_t level, Image2d<float>& out) const
+{
+  const auto in = pyramid.level(level);
+  if (out.height() != in.height() || out.width() != in.width())
+  {
+    out.allocUninitialized(in.size());
+  }
+
+  executeChain(in, out.view());
+}
+
+void OperationChain::executeChain(AnyConstImageView const& in, AnyImage& out) const
+{
+  detail::fit_image(out, outputType(pixel_type(in)), image_size(in));
+
+  execute(in, any_view(out), nullptr);
+}
+
+bool OperationChain::executeFused(StageIterator first, StageIterator last, AnyConstImageView const& in, AnyImageView const& out,
+  ExecutionControl const* control) const
+{
+  const auto h = image_size(in).y;
+  const auto w = image_size(in).x;
 
-    Image2d<float> tmp2(in.size());
+  // Rows above and below a strip that its output depends on through all the operations.
+  ptrdiff_t halo = 0;
+  for (auto it = first; it != last; ++it)
+    halo += it->op->haloRows().value();
 
-    for (auto& [id, op] : chain_)
+  auto strip_rows = strip_rows_;
+  if (strip_rows <= 0)
+  {
+    // Fit both strip buffers into a typical L2 cache, but keep the recomputed halo small.
+    // The rows are sized for float pixels, the largest type.
+    const auto row_bytes = ptrdiff_t(detail::aligned_stride<float>(w, 0) * sizeof(float));
+    const auto cache_rows = detail::fused_strip_bytes / (2 * std::max<ptrdiff_t>(row_bytes, 1));
+    strip_rows = std::max(cache_rows - 2 * halo, std::max<ptrdiff_t>(2 * halo, 8));
+  }
+
+  const auto buffer_rows = std::min(h, strip_rows + 2 * halo);
+  const auto n_strips = (h + strip_rows - 1) / strip_rows;
+
+  parallel_for(0, n_strips, 1, [&](ptrdiff_t strip_begin, ptrdiff_t strip_end)
+    {
+      detail::AnyScratchImage buffer1(Position(buffer_rows, w));
+      detail::AnyScratchImage buffer2(Position(buffer_rows, w));
+
+      for (auto strip = strip_begin; strip < strip_end; ++strip)
+      {
+        if (control && control->isCancelled())
+          return;
+
+        const auto y_begin = strip * strip_rows;
+        const auto y_end = std::min(h, y_begin + strip_rows);
+
+        // At the image borders the strip ends where the image does, so the operations
+        // apply their border conditions exactly as on the whole image.
+        const auto halo_begin = std::max<ptrdiff_t>(0, y_begin - halo);
+        const auto halo_end = std::min(h, y_end + halo);
+
+        AnyConstImageView stage_in = detail::rows(in, halo_begin, halo_end);
+        bool use_first = true;
+        for (auto it = first; it != last; ++it)
+        {
+          const auto type = it->op->outputType(it->op->inputType(pixel_type(stage_in)));
+          const auto buffer = use_first ? buffer1.view(type) : buffer2.view(type);
+          const auto stage_out = detail::rows(buffer, 0, halo_end - halo_begin);
+          detail::perform_converted(*it->op, stage_in, stage_out, nullptr);
+
+          stage_in = const_view(stage_out);
+          use_first = !use_first;
+        }
+
+        convert_image(detail::rows(stage_in, y_begin - halo_begin, y_end - halo_begin), detail::rows(out, y_begin, y_end));
+      }
+    });
+
+  return !(control && control->isCancelled());
+}
+
+bool OperationChain::executeCached(AnyConstImageView const& in, AnyImageView const& out, std::vector<OpProfile>* profile,
+  ExecutionControl const* control) const
+{
+  std::lock_guard<std::mutex> lock(cache_mutex_);
+
+  // A different input invalidates all the stages.
+  const auto in_size = image_size(in);
+  const auto cached_size = image_size(cached_input_);
+  const auto data = [](AnyConstImageView const& img)
+  {
+    return std::visit([](auto const& view) { return static_cast<void const*>(view.data()); }, img);
+  };
+  const auto stride = [](AnyConstImageView const& img)
+  {
+    return std::visit([](auto const& view) { return view.stride(); }, img);
+  };
+  if (in.index() != cached_input_.index() || data(in) != data(cached_input_) || in_size.y != cached_size.y ||
+    in_size.x != cached_size.x || stride(in) != stride(cached_input_))
+  {
+    cached_stages_ = 0;
+    cached_input_ = in;
+  }
+
+  if (profile)
+  {
+    for (size_t i = 0; i < cached_stages_; ++i)
+    {
+      OpProfile stage_profile;
+      stage_profile.id = chain_[i].id;
+      stage_profile.cached = true;
+      profile->push_back(stage_profile);
+    }
+  }
+
+  if (control)
+    control->reportProgress(cached_stages_, chain_.size());
+
+  AnyConstImageView stage_in = cached_stages_ > 0 ? any_view(std::as_const(chain_[cached_stages_ - 1].result)) : in;
+  for (auto i = cached_stages_; i < chain_.size(); ++i)
+  {
+    // The results of the finished stages stay valid.
+    if (control && control->isCancelled())
+    {
+      cached_stages_ = i;
+      return false;
+    }
+
+    auto& result = chain_[i].result;
+    auto const& op = *chain_[i].op;
+    detail::fit_image(result, op.outputType(op.inputType(pixel_type(stage_in))), in_size);
+
+    performStage(chain_[i], stage_in, any_view(result), nullptr, profile);
+    if (control && control->isCancelled())
     {
-      op->perform(tmp1, tmp2);
-      std::swap(tmp1, tmp2);
+      // The stage was interrupted, its result is incomplete.
+      cached_stages_ = i;
+      return false;
     }
 
-    out = std::move(tmp1);
+    stage_in = any_view(std::as_const(result));
+
+    if (control)
+      control->reportProgress(i + 1, chain_.size());
+  }
+
+  cached_stages_ = chain_.size();
+
+  convert_image(stage_in, out);
+  return !(control && control->isCancelled());
+}
+
+void OperationChain::performStage(Stage const& stage, AnyConstImageView const& in, AnyImageView const& out,
+  detail::AnyScratchImage* converted, std::vector<OpProfile>* profile)
+{
+  if (!profile)
+  {
+    detail::perform_converted(*stage.op, in, out, converted);
+    return;
   }
+
+  const auto bytes_before = allocated_image_bytes();
+  const auto start = std::chrono::steady_clock::now();
+
+  detail::perform_converted(*stage.op, in, out, converted);
+
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  const auto size = image_size(in);
+
+  OpProfile stage_profile;
+  stage_profile.id = stage.id;
+  stage_profile.seconds = elapsed.count();
+  stage_profile.bytes_allocated = allocated_image_bytes() - bytes_before;
+  stage_profile.pixels_per_second = elapsed.count() > 0.0 ? double(size.y * size.x) / elapsed.count() : 0.0;
+  profile->push_back(stage_profile);
 }
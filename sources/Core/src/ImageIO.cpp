@@ -0,0 +1,155 @@
+#include <Core/ImageIO.hpp>
+
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace detail
+{
+  // Headers of more pixels are rejected before allocating the image (16 GiB as floats).
+  constexpr int64_t max_pnm_pixels = int64_t(1) << 32;
+
+  // Reads the next header number, skipping white space and comments.
+  long read_pnm_header_value(std::istream& file)
+  {
+    while (true)
+    {
+      const auto c = file.peek();
+      if (c == '#')
+      {
+        std::string comment;
+        std::getline(file, comment);
+      }
+      else if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+      {
+        file.get();
+      }
+      else
+      {
+        break;
+      }
+    }
+
+    long value = -1;
+    file >> value;
+    return value;
+  }
+}
+
+void read_pnm(std::string const& file_name, Image2d<float>& img)
+{
+  std::ifstream file(file_name, std::ios::binary);
+  if (!file)
+    throw std::runtime_error("cannot open '" + file_name + "'");
+
+  std::string magic(2, '\0');
+  file.read(&magic[0], 2);
+  const bool binary = magic == "P5" || magic == "P6";
+  const bool color = magic == "P3" || magic == "P6";
+  if (!binary && magic != "P2" && !color)
+    throw std::runtime_error("'" + file_name + "' is not a PGM or PPM file");
+
+  const auto w = detail::read_pnm_header_value(file);
+  const auto h = detail::read_pnm_header_value(file);
+  const auto max_val = detail::read_pnm_header_value(file);
+  if (!file || w <= 0 || h <= 0 || max_val <= 0 || max_val > 65535 || int64_t(w) > detail::max_pnm_pixels / h)
+    throw std::runtime_error("'" + file_name + "' has an invalid header");
+
+  // A single white space separates the header from binary pixels.
+  file.get();
+
+  const ptrdiff_t channels = color ? 3 : 1;
+  const ptrdiff_t sample_bytes = max_val > 255 ? 2 : 1;
+
+  // Every sample takes at least one byte in ASCII files, so a file too short for its
+  // header fails before the image is allocated.
+  const auto data_begin = file.tellg();
+  file.seekg(0, std::ios::end);
+  const auto data_bytes = int64_t(file.tellg() - data_begin);
+  file.seekg(data_begin);
+  if (data_bytes < int64_t(h) * int64_t(w) * channels * (binary ? sample_bytes : 1))
+    throw std::runtime_error("'" + file_name + "' is truncated");
+
+  if (img.height() != h || img.width() != w)
+    img.allocUninitialized(h, w);
+
+  const auto scale = 1.f / float(channels);
+
+  std::vector<unsigned char> row_bytes(static_cast<size_t>(w * channels * sample_bytes));
+  for (ptrdiff_t y = 0; y < h; ++y)
+  {
+    const auto row = img.row(y);
+    if (binary)
+    {
+      file.read(reinterpret_cast<char*>(row_bytes.data()), std::streamsize(row_bytes.size()));
+      for (ptrdiff_t x = 0; x < w; ++x)
+      {
+        float sum = 0.f;
+        for (ptrdiff_t c = 0; c < channels; ++c)
+        {
+          const auto sample = &row_bytes[size_t((x * channels + c) * sample_bytes)];
+          sum += sample_bytes == 2 ? float((sample[0] << 8) | sample[1]) : float(sample[0]);
+        }
+
+        row[x] = scale * sum;
+      }
+    }
+    else
+    {
+      for (ptrdiff_t x = 0; x < w; ++x)
+      {
+        float sum = 0.f;
+        for (ptrdiff_t c = 0; c < channels; ++c)
+        {
+          long sample = 0;
+          file >> sample;
+          sum += float(sample);
+        }
+
+        row[x] = scale * sum;
+      }
+    }
+
+    if (!file)
+      throw std::runtime_error("'" + file_name + "' is truncated");
+  }
+}
+
+void write_pgm(std::string const& file_name, AnyConstImageView const& img)
+{
+  std::ofstream file(file_name, std::ios::binary);
+  if (!file)
+    throw std::runtime_error("cannot create '" + file_name + "'");
+
+  const auto size = image_size(img);
+  const bool wide = pixel_type(img) == PixelType::U16;
+  file << "P5\n" << size.x << ' ' << size.y << '\n' << (wide ? 65535 : 255) << '\n';
+
+  std::vector<unsigned char> row_bytes(static_cast<size_t>(size.x * (wide ? 2 : 1)));
+  std::visit([&](auto const& view)
+    {
+      using T = typename std::decay_t<decltype(view)>::value_type;
+      for (ptrdiff_t y = 0; y < view.height(); ++y)
+      {
+        const auto row = view.row(y);
+        for (ptrdiff_t x = 0; x < view.width(); ++x)
+        {
+          if constexpr (std::is_same_v<T, uint16_t>)
+          {
+            row_bytes[size_t(2 * x)] = static_cast<unsigned char>(row[x] >> 8);
+            row_bytes[size_t(2 * x + 1)] = static_cast<unsigned char>(row[x] & 0xff);
+          }
+          else
+          {
+            row_bytes[size_t(x)] = detail::convert_pixel<unsigned char>(row[x]);
+          }
+        }
+
+        file.write(reinterpret_cast<char const*>(row_bytes.data()), std::streamsize(row_bytes.size()));
+      }
+    }, img);
+
+  if (!file)
+    throw std::runtime_error("cannot write '" + file_name + "'");
+}
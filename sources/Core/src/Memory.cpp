@@ -0,0 +1,116 @@
+#include <Core/Memory.hpp>
+
+#include <atomic>
+#include <cstring>
+#include <new>
+
+namespace detail
+{
+  std::atomic<size_t> allocated_bytes{ 0 };
+
+  void AlignedDelete::operator()(unsigned char* ptr) const
+  {
+    ::operator delete[](ptr, std::align_val_t(image_row_alignment));
+  }
+
+  AlignedBuffer alloc_aligned_buffer(size_t bytes, bool zero_init)
+  {
+    auto ptr = static_cast<unsigned char*>(::operator new[](bytes, std::align_val_t(image_row_alignment)));
+    allocated_bytes.fetch_add(bytes, std::memory_order_relaxed);
+    if (zero_init)
+      std::memset(ptr, 0, bytes);
+
+    return AlignedBuffer(ptr);
+  }
+}
+
+size_t allocated_image_bytes()
+{
+  return detail::allocated_bytes.load(std::memory_order_relaxed);
+}
+
+ImagePool& ImagePool::global()
+{
+  static ImagePool pool;
+  return pool;
+}
+
+detail::AlignedBuffer ImagePool::acquire(size_t bytes)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (auto it = buffers_.find(bytes); it != buffers_.end())
+    {
+      auto buffer = std::move(it->second);
+      buffers_.erase(it);
+      cached_bytes_ -= bytes;
+
+      ++stats_.reuses;
+      stats_.bytes_reused += bytes;
+
+      return buffer;
+    }
+
+    ++stats_.allocations;
+  }
+
+  // Pooled buffers are scratch memory, so they are not cleared.
+  return detail::alloc_aligned_buffer(bytes, false);
+}
+
+void ImagePool::release(detail::AlignedBuffer buffer, size_t bytes)
+{
+  if (!buffer)
+    return;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (cached_bytes_ + bytes > capacity_)
+    return;
+
+  buffers_.emplace(bytes, std::move(buffer));
+  cached_bytes_ += bytes;
+}
+
+void ImagePool::setCapacity(size_t bytes)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  capacity_ = bytes;
+
+  // Drop cached buffers until the pool fits in the new capacity.
+  for (auto it = buffers_.begin(); it != buffers_.end() && cached_bytes_ > capacity_;)
+  {
+    cached_bytes_ -= it->first;
+    it = buffers_.erase(it);
+  }
+}
+
+size_t ImagePool::capacity() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return capacity_;
+}
+
+size_t ImagePool::cachedBytes() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return cached_bytes_;
+}
+
+void ImagePool::clear()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  buffers_.clear();
+  cached_bytes_ = 0;
+}
+
+ImagePoolStats ImagePool::stats() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+void ImagePool::resetStats()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats_ = ImagePoolStats();
+}
@@ -0,0 +1,241 @@
+#include <Core/Parallel.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace detail
+{
+  // Set while a thread executes a band (on the pool's workers permanently), so that
+  // nested parallel calls run serially instead of waiting for the occupied workers.
+  thread_local bool in_parallel_region = false;
+
+  // Flag of the innermost CancellationScope, handed on to the bands run by the pool.
+  thread_local std::atomic<bool> const* cancel_flag = nullptr;
+
+  // Calls func on consecutive chunks of [begin, end), stopping once the flag is set.
+  void run_cancellable(ptrdiff_t begin, ptrdiff_t end, ptrdiff_t chunk, std::atomic<bool> const& flag,
+    std::function<void(ptrdiff_t, ptrdiff_t)> const& func)
+  {
+    for (auto chunk_begin = begin; chunk_begin < end && !flag.load(std::memory_order_relaxed); chunk_begin += chunk)
+      func(chunk_begin, std::min(chunk_begin + chunk, end));
+  }
+
+  // Runs a band of a parallel loop, in chunks if there is a cancellation flag.
+  void run_band(ptrdiff_t begin, ptrdiff_t end, ptrdiff_t chunk, std::atomic<bool> const* flag,
+    std::function<void(ptrdiff_t, ptrdiff_t)> const& func)
+  {
+    if (flag)
+      run_cancellable(begin, end, chunk, *flag, func);
+    else
+      func(begin, end);
+  }
+
+  std::atomic<size_t> max_threads_setting{ 0 };
+
+  size_t hardware_threads()
+  {
+    return std::max<size_t>(1, std::thread::hardware_concurrency());
+  }
+
+  class ThreadPool
+  {
+  public:
+    ~ThreadPool()
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+      }
+      cv_.notify_all();
+
+      for (auto& worker : workers_)
+        worker.join();
+    }
+
+    // Grows the pool so that it holds at least n workers.
+    void reserve(size_t n)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      while (workers_.size() < n)
+      {
+        workers_.emplace_back([this]() { this->run(); });
+      }
+    }
+
+    void submit(std::function<void()> task)
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.push_back(std::move(task));
+      }
+      cv_.notify_one();
+    }
+
+  private:
+    void run()
+    {
+      in_parallel_region = true;
+
+      while (true)
+      {
+        std::function<void()> task;
+        {
+          std::unique_lock<std::mutex> lock(mutex_);
+          cv_.wait(lock, [this]() { return stop_ || !tasks_.empty(); });
+          if (stop_ && tasks_.empty())
+            return;
+
+          task = std::move(tasks_.front());
+          tasks_.pop_front();
+        }
+
+        task();
+      }
+    }
+
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_ = false;
+  };
+
+  ThreadPool& thread_pool()
+  {
+    static ThreadPool pool;
+    return pool;
+  }
+
+  // Counts down the outstanding bands and keeps the first exception thrown by any of them.
+  class BandLatch
+  {
+  public:
+    explicit BandLatch(size_t count) : count_(count) {}
+
+    void done(std::exception_ptr error)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (error && !error_)
+        error_ = error;
+
+      if (--count_ == 0)
+        cv_.notify_all();
+    }
+
+    void wait()
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this]() { return count_ == 0; });
+
+      if (error_)
+        std::rethrow_exception(error_);
+    }
+
+  private:
+    size_t count_;
+    std::exception_ptr error_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+  };
+
+  void parallel_for_impl(ptrdiff_t begin, ptrdiff_t end, ptrdiff_t min_band,
+    std::function<void(ptrdiff_t, ptrdiff_t)> const& func)
+  {
+    const auto len = end - begin;
+    if (len <= 0)
+      return;
+
+    const auto chunk = std::max<ptrdiff_t>(min_band, 1);
+    const auto flag = cancel_flag;
+    const auto max_bands = len / chunk;
+    const auto n_bands = std::min<ptrdiff_t>(ptrdiff_t(max_threads()), max_bands);
+    if (n_bands <= 1 || in_parallel_region)
+    {
+      run_band(begin, end, chunk, flag, func);
+      return;
+    }
+
+    auto& pool = thread_pool();
+    pool.reserve(size_t(n_bands - 1));
+
+    // Distribute the remainder over the leading bands.
+    const auto band_len = len / n_bands;
+    const auto remainder = len % n_bands;
+    const auto band_begin = [=](ptrdiff_t band)
+    {
+      return begin + band * band_len + std::min(band, remainder);
+    };
+
+    BandLatch latch(size_t(n_bands - 1));
+    for (ptrdiff_t band = 1; band < n_bands; ++band)
+    {
+      const auto b = band_begin(band);
+      const auto e = band_begin(band + 1);
+      pool.submit([&func, &latch, b, e, chunk, flag]()
+        {
+          std::exception_ptr error;
+          cancel_flag = flag;
+          try
+          {
+            run_band(b, e, chunk, flag, func);
+          }
+          catch (...)
+          {
+            error = std::current_exception();
+          }
+          cancel_flag = nullptr;
+
+          latch.done(error);
+        });
+    }
+
+    std::exception_ptr error;
+    in_parallel_region = true;
+    try
+    {
+      run_band(begin, band_begin(1), chunk, flag, func);
+    }
+    catch (...)
+    {
+      error = std::current_exception();
+    }
+    in_parallel_region = false;
+
+    latch.wait();
+
+    if (error)
+      std::rethrow_exception(error);
+  }
+}
+
+CancellationScope::CancellationScope(std::atomic<bool> const& flag) : prev_flag_(detail::cancel_flag)
+{
+  detail::cancel_flag = &flag;
+}
+
+CancellationScope::~CancellationScope()
+{
+  detail::cancel_flag = prev_flag_;
+}
+
+bool cancellation_requested()
+{
+  return detail::cancel_flag && detail::cancel_flag->load(std::memory_order_relaxed);
+}
+
+void set_max_threads(size_t n)
+{
+  detail::max_threads_setting = n;
+}
+
+size_t max_threads()
+{
+  const auto n = detail::max_threads_setting.load();
+  return n == 0 ? detail::hardware_threads() : n;
+}
@@ -0,0 +1,270 @@
+#include <Core/Serialization.hpp>
+
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+namespace detail
+{
+  // Parameters of an operation line, removed as they are read so that unknown ones
+  // can be reported.
+  class OpParams
+  {
+  public:
+    explicit OpParams(std::istream& tokens)
+    {
+      std::string token;
+      while (tokens >> token)
+      {
+        const auto eq = token.find('=');
+        if (eq == std::string::npos || eq == 0)
+          throw std::runtime_error("expected key=value, got '" + token + "'");
+
+        if (!params_.emplace(token.substr(0, eq), token.substr(eq + 1)).second)
+          throw std::runtime_error("duplicate parameter '" + token.substr(0, eq) + "'");
+      }
+    }
+
+    std::string text(std::string const& key)
+    {
+      const auto it = params_.find(key);
+      if (it == params_.end())
+        throw std::runtime_error("missing parameter '" + key + "'");
+
+      auto value = std::move(it->second);
+      params_.erase(it);
+      return value;
+    }
+
+    float real(std::string const& key)
+    {
+      const auto value = text(key);
+      size_t end = 0;
+      float res = 0.f;
+      try
+      {
+        res = std::stof(value, &end);
+      }
+      catch (std::exception const&)
+      {
+        end = 0;
+      }
+
+      if (end == 0 || end != value.size())
+        throw std::runtime_error("parameter '" + key + "' is not a number: '" + value + "'");
+
+      return res;
+    }
+
+    ptrdiff_t integer(std::string const& key)
+    {
+      const auto value = text(key);
+      size_t end = 0;
+      long long res = 0;
+      try
+      {
+        res = std::stoll(value, &end);
+      }
+      catch (std::exception const&)
+      {
+        end = 0;
+      }
+
+      if (end == 0 || end != value.size() || res < 0)
+        throw std::runtime_error("parameter '" + key + "' is not a non-negative integer: '" + value + "'");
+
+      return ptrdiff_t(res);
+    }
+
+    template<typename E>
+    E choice(std::string const& key, std::vector<std::pair<std::string, E>> const& choices)
+    {
+      const auto value = text(key);
+      for (auto const& [name, choice] : choices)
+      {
+        if (name == value)
+          return choice;
+      }
+
+      throw std::runtime_error("parameter '" + key + "' has an unknown value '" + value + "'");
+    }
+
+    // Throws if any parameter was not read.
+    void finish() const
+    {
+      if (!params_.empty())
+        throw std::runtime_error("unknown parameter '" + params_.begin()->first + "'");
+    }
+
+  private:
+    std::map<std::string, std::string> params_;
+  };
+
+  const std::vector<std::pair<std::string, FilterConfig::Method>> filter_methods = {
+    { "fir", FilterConfig::Method::FIR },
+    { "iir", FilterConfig::Method::IIR } };
+
+  const std::vector<std::pair<std::string, GradConfig::GradType>> grad_types = {
+    { "x", GradConfig::GradType::GradX },
+    { "y", GradConfig::GradType::GradY },
+    { "abs", GradConfig::GradType::GradAbs } };
+
+  const std::vector<std::pair<std::string, MorphConfig::MorphType>> morph_types = {
+    { "erode", MorphConfig::MorphType::Erode },
+    { "dilate", MorphConfig::MorphType::Dilate },
+    { "open", MorphConfig::MorphType::Open },
+    { "close", MorphConfig::MorphType::Close } };
+
+  template<typename E>
+  std::string choice_name(std::vector<std::pair<std::string, E>> const& choices, E value)
+  {
+    for (auto const& [name, choice] : choices)
+    {
+      if (choice == value)
+        return name;
+    }
+
+    return std::string();
+  }
+
+  struct OpConfigWriter
+  {
+    void operator()(ThresholdConfig const& config)
+    {
+      stream << "threshold thresh=" << config.thresh << " true=" << config.true_val << " false=" << config.false_val;
+    }
+
+    void operator()(FilterConfig const& config)
+    {
+      stream << "filter method=" << choice_name(filter_methods, config.method) <<
+        " radius_x=" << config.kernel_radius_x << " radius_y=" << config.kernel_radius_y <<
+        " sigma_x=" << config.sigma_x << " sigma_y=" << config.sigma_y;
+    }
+
+    void operator()(GradConfig const& config)
+    {
+      stream << "gradient type=" << choice_name(grad_types, config.type);
+    }
+
+    void operator()(CannyConfig const& config)
+    {
+      stream << "canny lo=" << config.lo_thresh << " hi=" << config.hi_thresh;
+    }
+
+    void operator()(MorphConfig const& config)
+    {
+      stream << "morph type=" << choice_name(morph_types, config.type) <<
+        " radius_x=" << config.kernel_radius_x << " radius_y=" << config.kernel_radius_y;
+    }
+
+    std::ostream& stream;
+  };
+}
+
+std::string op_config_to_string(OpConfig const& config)
+{
+  std::ostringstream stream;
+
+  // Enough digits that the floats are read back exactly.
+  stream.precision(9);
+  std::visit(detail::OpConfigWriter{ stream }, config);
+
+  return stream.str();
+}
+
+OpConfig parse_op_config(std::string const& line)
+{
+  std::istringstream tokens(line);
+  std::string name;
+  if (!(tokens >> name))
+    throw std::runtime_error("missing operation name");
+
+  detail::OpParams params(tokens);
+  OpConfig config;
+  if (name == "threshold")
+  {
+    const auto thresh = params.real("thresh");
+    const auto true_val = params.real("true");
+    const auto false_val = params.real("false");
+    config = ThresholdConfig{ thresh, true_val, false_val };
+  }
+  else if (name == "filter")
+  {
+    FilterConfig filter_config;
+    filter_config.method = params.choice("method", detail::filter_methods);
+    filter_config.kernel_radius_x = params.integer("radius_x");
+    filter_config.kernel_radius_y = params.integer("radius_y");
+    filter_config.sigma_x = params.real("sigma_x");
+    filter_config.sigma_y = params.real("sigma_y");
+    config = filter_config;
+  }
+  else if (name == "gradient")
+  {
+    config = GradConfig{ params.choice("type", detail::grad_types) };
+  }
+  else if (name == "canny")
+  {
+    const auto lo = params.real("lo");
+    const auto hi = params.real("hi");
+    config = CannyConfig{ lo, hi };
+  }
+  else if (name == "morph")
+  {
+    MorphConfig morph_config;
+    morph_config.type = params.choice("type", detail::morph_types);
+    morph_config.kernel_radius_x = params.integer("radius_x");
+    morph_config.kernel_radius_y = params.integer("radius_y");
+    config = morph_config;
+  }
+  else
+  {
+    throw std::runtime_error("unknown operation '" + name + "'");
+  }
+
+  params.finish();
+  return config;
+}
+
+void write_chain(std::ostream& stream, std::vector<OpConfig> const& chain)
+{
+  for (auto const& config : chain)
+    stream << op_config_to_string(config) << '\n';
+}
+
+std::vector<OpConfig> read_chain(std::istream& stream)
+{
+  std::vector<OpConfig> chain;
+
+  std::string line;
+  size_t line_number = 0;
+  while (std::getline(stream, line))
+  {
+    ++line_number;
+
+    const auto first = line.find_first_not_of(" \t\r");
+    if (first == std::string::npos || line[first] == '#')
+      continue;
+
+    try
+    {
+      chain.push_back(parse_op_config(line));
+    }
+    catch (std::runtime_error const& error)
+    {
+      throw std::runtime_error("line " + std::to_string(line_number) + ": " + error.what());
+    }
+  }
+
+  return chain;
+}
+
+std::vector<OpConfig> read_chain(std::string const& file_name)
+{
+  std::ifstream file(file_name);
+  if (!file)
+    throw std::runtime_error("cannot open chain description '" + file_name + "'");
+
+  return read_chain(file);
+}
@@ -0,0 +1,676 @@
+#include <Core/Simd.hpp>
+#include <Core/BinaryImage.hpp>
+#include <Core/Core.hpp>
+
+#include <atomic>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CORE_SIMD_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang need the instruction set enabled per function, MSVC accepts the intrinsics anywhere.
+#if defined(__GNUC__) || defined(__clang__)
+#define CORE_TARGET_SSE2 __attribute__((target("sse2")))
+#define CORE_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define CORE_TARGET_SSE2
+#define CORE_TARGET_AVX2
+#endif
+
+namespace detail
+{
+  std::atomic<SimdLevel> max_simd_level{ SimdLevel::AVX2 };
+
+  SimdLevel supported_simd_level()
+  {
+#if defined(CORE_SIMD_X86)
+#if defined(_MSC_VER)
+    int info[4] = {};
+    __cpuid(info, 1);
+    const bool has_sse2 = (info[3] & (1 << 26)) != 0;
+    const bool has_osxsave = (info[2] & (1 << 27)) != 0;
+    const bool has_avx = (info[2] & (1 << 28)) != 0;
+
+    // AVX registers have to be enabled by the OS as well.
+    const bool os_avx = has_osxsave && has_avx && (_xgetbv(0) & 0x6) == 0x6;
+
+    __cpuidex(info, 7, 0);
+    const bool has_avx2 = os_avx && (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    const bool has_sse2 = __builtin_cpu_supports("sse2");
+    const bool has_avx2 = __builtin_cpu_supports("avx2");
+#endif
+    if (has_avx2) return SimdLevel::AVX2;
+    if (has_sse2) return SimdLevel::SSE2;
+#endif
+    return SimdLevel::Scalar;
+  }
+
+#if defined(CORE_SIMD_X86)
+  CORE_TARGET_SSE2
+  void filter_x_inner_row_sse2(float const* src_row, float const* kernel, ptrdiff_t kernel_sz,
+    ptrdiff_t width, float* dst_row)
+  {
+    const ptrdiff_t kernel_radius = kernel_sz / 2;
+    const ptrdiff_t j_end = width - kernel_radius;
+
+    ptrdiff_t j = kernel_radius;
+    for (; j + 4 <= j_end; j += 4)
+    {
+      float const* src = src_row + j - kernel_radius;
+      __m128 filtered = _mm_setzero_ps();
+      for (ptrdiff_t ik = 0; ik < kernel_sz; ++ik)
+        filtered = _mm_add_ps(filtered, _mm_mul_ps(_mm_set1_ps(kernel[ik]), _mm_loadu_ps(src + ik)));
+
+      _mm_storeu_ps(dst_row + j, filtered);
+    }
+
+    // Remaining pixels.
+    for (; j < j_end; ++j)
+    {
+      float const* src = src_row + j - kernel_radius;
+      float filtered = 0.f;
+      for (ptrdiff_t ik = 0; ik < kernel_sz; ++ik)
+        filtered += kernel[ik] * src[ik];
+
+      dst_row[j] = filtered;
+    }
+  }
+
+  CORE_TARGET_AVX2
+  void filter_x_inner_row_avx2(float const* src_row, float const* kernel, ptrdiff_t kernel_sz,
+    ptrdiff_t width, float* dst_row)
+  {
+    const ptrdiff_t kernel_radius = kernel_sz / 2;
+    const ptrdiff_t j_end = width - kernel_radius;
+
+    ptrdiff_t j = kernel_radius;
+    for (; j + 8 <= j_end; j += 8)
+    {
+      float const* src = src_row + j - kernel_radius;
+      __m256 filtered = _mm256_setzero_ps();
+      for (ptrdiff_t ik = 0; ik < kernel_sz; ++ik)
+        filtered = _mm256_add_ps(filtered, _mm256_mul_ps(_mm256_set1_ps(kernel[ik]), _mm256_loadu_ps(src + ik)));
+
+      _mm256_storeu_ps(dst_row + j, filtered);
+    }
+
+    // Remaining pixels.
+    for (; j < j_end; ++j)
+    {
+      float const* src = src_row + j - kernel_radius;
+      float filtered = 0.f;
+      for (ptrdiff_t ik = 0; ik < kernel_sz; ++ik)
+        filtered += kernel[ik] * src[ik];
+
+      dst_row[j] = filtered;
+    }
+  }
+
+  CORE_TARGET_SSE2
+  void filter_y_inner_row_sse2(float const* src_rows, ptrdiff_t src_stride, float const* kernel,
+    ptrdiff_t kernel_sz, ptrdiff_t width, float* dst_row)
+  {
+    ptrdiff_t j = 0;
+    for (; j + 4 <= width; j += 4)
+    {
+      float const* src = src_rows + j;
+      __m128 filtered = _mm_setzero_ps();
+      for (ptrdiff_t ik = 0; ik < kernel_sz; ++ik)
+        filtered = _mm_add_ps(filtered, _mm_mul_ps(_mm_set1_ps(kernel[ik]), _mm_loadu_ps(src + ik * src_stride)));
+
+      _mm_storeu_ps(dst_row + j, filtered);
+    }
+
+    // Remaining pixels.
+    for (; j < width; ++j)
+    {
+      float filtered = 0.f;
+      for (ptrdiff_t ik = 0; ik < kernel_sz; ++ik)
+        filtered += kernel[ik] * src_rows[ik * src_stride + j];
+
+      dst_row[j] = filtered;
+    }
+  }
+
+  CORE_TARGET_AVX2
+  void filter_y_inner_row_avx2(float const* src_rows, ptrdiff_t src_stride, float const* kernel,
+    ptrdiff_t kernel_sz, ptrdiff_t width, float* dst_row)
+  {
+    ptrdiff_t j = 0;
+    for (; j + 8 <= width; j += 8)
+    {
+      float const* src = src_rows + j;
+      __m256 filtered = _mm256_setzero_ps();
+      for (ptrdiff_t ik = 0; ik < kernel_sz; ++ik)
+        filtered = _mm256_add_ps(filtered, _mm256_mul_ps(_mm256_set1_ps(kernel[ik]), _mm256_loadu_ps(src + ik * src_stride)));
+
+      _mm256_storeu_ps(dst_row + j, filtered);
+    }
+
+    // Remaining pixels.
+    for (; j < width; ++j)
+    {
+      float filtered = 0.f;
+      for (ptrdiff_t ik = 0; ik < kernel_sz; ++ik)
+        filtered += kernel[ik] * src_rows[ik * src_stride + j];
+
+      dst_row[j] = filtered;
+    }
+  }
+
+  // (a + 2 * b) + c, in the order of the scalar kernel.
+  CORE_TARGET_SSE2
+  inline __m128 smooth_121_sse2(float const* a, float const* b, float const* c)
+  {
+    return _mm_add_ps(_mm_add_ps(_mm_loadu_ps(a), _mm_mul_ps(_mm_set1_ps(2.f), _mm_loadu_ps(b))), _mm_loadu_ps(c));
+  }
+
+  CORE_TARGET_SSE2
+  void sobel_inner_row_sse2(float const* row_up, float const* row_mid, float const* row_down, ptrdiff_t width,
+    bool squared, float* magnitude_row, float* grad_x_row, float* grad_y_row)
+  {
+    ptrdiff_t j = 1;
+    for (; j + 4 <= width - 1; j += 4)
+    {
+      const __m128 gx = _mm_sub_ps(
+        smooth_121_sse2(row_up + j + 1, row_mid + j + 1, row_down + j + 1),
+        smooth_121_sse2(row_up + j - 1, row_mid + j - 1, row_down + j - 1));
+      const __m128 gy = _mm_sub_ps(
+        smooth_121_sse2(row_down + j - 1, row_down + j, row_down + j + 1),
+        smooth_121_sse2(row_up + j - 1, row_up + j, row_up + j + 1));
+      const __m128 sq = _mm_add_ps(_mm_mul_ps(gx, gx), _mm_mul_ps(gy, gy));
+      _mm_storeu_ps(magnitude_row + j, squared ? sq : _mm_sqrt_ps(sq));
+      if (grad_x_row)
+      {
+        _mm_storeu_ps(grad_x_row + j, gx);
+        _mm_storeu_ps(grad_y_row + j, gy);
+      }
+    }
+
+    // Remaining pixels.
+    const auto offset = j - 1;
+    sobel_inner_row<float>(row_up + offset, row_mid + offset, row_down + offset, width - offset, squared,
+      magnitude_row + offset, grad_x_row ? grad_x_row + offset : nullptr, grad_y_row ? grad_y_row + offset : nullptr);
+  }
+
+  // (a + 2 * b) + c, in the order of the scalar kernel.
+  CORE_TARGET_AVX2
+  inline __m256 smooth_121_avx2(float const* a, float const* b, float const* c)
+  {
+    return _mm256_add_ps(_mm256_add_ps(_mm256_loadu_ps(a), _mm256_mul_ps(_mm256_set1_ps(2.f), _mm256_loadu_ps(b))), _mm256_loadu_ps(c));
+  }
+
+  CORE_TARGET_AVX2
+  void sobel_inner_row_avx2(float const* row_up, float const* row_mid, float const* row_down, ptrdiff_t width,
+    bool squared, float* magnitude_row, float* grad_x_row, float* grad_y_row)
+  {
+    ptrdiff_t j = 1;
+    for (; j + 8 <= width - 1; j += 8)
+    {
+      const __m256 gx = _mm256_sub_ps(
+        smooth_121_avx2(row_up + j + 1, row_mid + j + 1, row_down + j + 1),
+        smooth_121_avx2(row_up + j - 1, row_mid + j - 1, row_down + j - 1));
+      const __m256 gy = _mm256_sub_ps(
+        smooth_121_avx2(row_down + j - 1, row_down + j, row_down + j + 1),
+        smooth_121_avx2(row_up + j - 1, row_up + j, row_up + j + 1));
+      const __m256 sq = _mm256_add_ps(_mm256_mul_ps(gx, gx), _mm256_mul_ps(gy, gy));
+      _mm256_storeu_ps(magnitude_row + j, squared ? sq : _mm256_sqrt_ps(sq));
+      if (grad_x_row)
+      {
+        _mm256_storeu_ps(grad_x_row + j, gx);
+        _mm256_storeu_ps(grad_y_row + j, gy);
+      }
+    }
+
+    // Remaining pixels.
+    const auto offset = j - 1;
+    sobel_inner_row<float>(row_up + offset, row_mid + offset, row_down + offset, width - offset, squared,
+      magnitude_row + offset, grad_x_row ? grad_x_row + offset : nullptr, grad_y_row ? grad_y_row + offset : nullptr);
+  }
+  // The bins are computed on 32 bit lanes: the tangent comparisons in double, then
+  // 1 or 3 from the sign bits, overridden by the vertical and horizontal masks.
+  CORE_TARGET_SSE2
+  void gradient_direction_row_sse2(float const* grad_x_row, float const* grad_y_row, ptrdiff_t width, int8_t* dst_row)
+  {
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    const __m128d tan_lo = _mm_set1_pd(tan_eighth_pi);
+    const __m128d tan_hi = _mm_set1_pd(tan_three_eighths_pi);
+
+    ptrdiff_t j = 0;
+    for (; j + 4 <= width; j += 4)
+    {
+      const __m128 gx = _mm_loadu_ps(grad_x_row + j);
+      const __m128 gy = _mm_loadu_ps(grad_y_row + j);
+      const __m128 ax = _mm_and_ps(gx, abs_mask);
+      const __m128 ay = _mm_and_ps(gy, abs_mask);
+
+      const __m128d ax_0 = _mm_cvtps_pd(ax);
+      const __m128d ay_0 = _mm_cvtps_pd(ay);
+      const __m128d ax_1 = _mm_cvtps_pd(_mm_movehl_ps(ax, ax));
+      const __m128d ay_1 = _mm_cvtps_pd(_mm_movehl_ps(ay, ay));
+
+      const __m128i horizontal = _mm_castps_si128(_mm_shuffle_ps(
+        _mm_castpd_ps(_mm_cmplt_pd(ay_0, _mm_mul_pd(tan_lo, ax_0))),
+        _mm_castpd_ps(_mm_cmplt_pd(ay_1, _mm_mul_pd(tan_lo, ax_1))), _MM_SHUFFLE(2, 0, 2, 0)));
+      const __m128i vertical = _mm_castps_si128(_mm_shuffle_ps(
+        _mm_castpd_ps(_mm_cmpge_pd(ay_0, _mm_mul_pd(tan_hi, ax_0))),
+        _mm_castpd_ps(_mm_cmpge_pd(ay_1, _mm_mul_pd(tan_hi, ax_1))), _MM_SHUFFLE(2, 0, 2, 0)));
+
+      const __m128i opposite = _mm_srai_epi32(_mm_castps_si128(_mm_xor_ps(gx, gy)), 31);
+      __m128i bins = _mm_add_epi32(_mm_set1_epi32(1), _mm_and_si128(opposite, _mm_set1_epi32(2)));
+      bins = _mm_or_si128(_mm_andnot_si128(vertical, bins), _mm_and_si128(vertical, _mm_set1_epi32(2)));
+      bins = _mm_andnot_si128(horizontal, bins);
+
+      const __m128i packed = _mm_packs_epi16(_mm_packs_epi32(bins, bins), _mm_setzero_si128());
+      const int32_t packed_bins = _mm_cvtsi128_si32(packed);
+      std::memcpy(dst_row + j, &packed_bins, 4);
+    }
+
+    // Remaining pixels.
+    gradient_direction_row<float>(grad_x_row + j, grad_y_row + j, width - j, dst_row + j);
+  }
+
+  // Compares ay with tangent * ax in double, returning 8 lanes of 32 bit masks.
+  template<int Predicate>
+  CORE_TARGET_AVX2
+  inline __m256i cmp_tangent_avx2(__m256 ay, __m256 ax, __m256d tangent)
+  {
+    const __m256d ax_0 = _mm256_cvtps_pd(_mm256_castps256_ps128(ax));
+    const __m256d ay_0 = _mm256_cvtps_pd(_mm256_castps256_ps128(ay));
+    const __m256d ax_1 = _mm256_cvtps_pd(_mm256_extractf128_ps(ax, 1));
+    const __m256d ay_1 = _mm256_cvtps_pd(_mm256_extractf128_ps(ay, 1));
+
+    const __m256d mask_0 = _mm256_cmp_pd(ay_0, _mm256_mul_pd(tangent, ax_0), Predicate);
+    const __m256d mask_1 = _mm256_cmp_pd(ay_1, _mm256_mul_pd(tangent, ax_1), Predicate);
+
+    // Gather the low halves of the 64 bit masks into 8 lanes of 32 bit.
+    const __m256i even = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+    const __m256i lanes_0 = _mm256_permutevar8x32_epi32(_mm256_castpd_si256(mask_0), even);
+    const __m256i lanes_1 = _mm256_permutevar8x32_epi32(_mm256_castpd_si256(mask_1), even);
+    return _mm256_blend_epi32(lanes_0, lanes_1, 0xf0);
+  }
+
+  CORE_TARGET_AVX2
+  void gradient_direction_row_avx2(float const* grad_x_row, float const* grad_y_row, ptrdiff_t width, int8_t* dst_row)
+  {
+    const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    const __m256d tan_lo = _mm256_set1_pd(tan_eighth_pi);
+    const __m256d tan_hi = _mm256_set1_pd(tan_three_eighths_pi);
+
+    ptrdiff_t j = 0;
+    for (; j + 8 <= width; j += 8)
+    {
+      const __m256 gx = _mm256_loadu_ps(grad_x_row + j);
+      const __m256 gy = _mm256_loadu_ps(grad_y_row + j);
+      const __m256 ax = _mm256_and_ps(gx, abs_mask);
+      const __m256 ay = _mm256_and_ps(gy, abs_mask);
+
+      const __m256i horizontal = cmp_tangent_avx2<_CMP_LT_OQ>(ay, ax, tan_lo);
+      const __m256i vertical = cmp_tangent_avx2<_CMP_GE_OQ>(ay, ax, tan_hi);
+
+      const __m256i opposite = _mm256_srai_epi32(_mm256_castps_si256(_mm256_xor_ps(gx, gy)), 31);
+      __m256i bins = _mm256_add_epi32(_mm256_set1_epi32(1), _mm256_and_si256(opposite, _mm256_set1_epi32(2)));
+      bins = _mm256_blendv_epi8(bins, _mm256_set1_epi32(2), vertical);
+      bins = _mm256_andnot_si256(horizontal, bins);
+
+      const __m128i bins_16 = _mm_packs_epi32(_mm256_castsi256_si128(bins), _mm256_extracti128_si256(bins, 1));
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(dst_row + j), _mm_packs_epi16(bins_16, bins_16));
+    }
+
+    // Remaining pixels.
+    gradient_direction_row<float>(grad_x_row + j, grad_y_row + j, width - j, dst_row + j);
+  }
+
+  // Every comparison of 8 pixels yields a byte of the word through movemask.
+  CORE_TARGET_SSE2
+  void threshold_pack_row_sse2(float const* src_row, ptrdiff_t width, float threshold, uint64_t* dst_row)
+  {
+    const __m128 thresh = _mm_set1_ps(threshold);
+
+    ptrdiff_t j = 0;
+    for (; j + 64 <= width; j += 64)
+    {
+      uint64_t word = 0;
+      for (ptrdiff_t k = 0; k < 64; k += 4)
+        word |= uint64_t(_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(src_row + j + k), thresh))) << k;
+
+      dst_row[j / 64] = word;
+    }
+
+    // Remaining pixels.
+    threshold_pack_row<float>(src_row + j, width - j, threshold, dst_row + j / 64);
+  }
+
+  CORE_TARGET_AVX2
+  void threshold_pack_row_avx2(float const* src_row, ptrdiff_t width, float threshold, uint64_t* dst_row)
+  {
+    const __m256 thresh = _mm256_set1_ps(threshold);
+
+    ptrdiff_t j = 0;
+    for (; j + 64 <= width; j += 64)
+    {
+      uint64_t word = 0;
+      for (ptrdiff_t k = 0; k < 64; k += 8)
+        word |= uint64_t(_mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(src_row + j + k), thresh, _CMP_GE_OQ))) << k;
+
+      dst_row[j / 64] = word;
+    }
+
+    // Remaining pixels.
+    threshold_pack_row<float>(src_row + j, width - j, threshold, dst_row + j / 64);
+  }
+
+  CORE_TARGET_SSE2
+  void min_max_row_sse2(float const* src_row, ptrdiff_t width, float& min, float& max)
+  {
+    ptrdiff_t j = 0;
+    if (width >= 4)
+    {
+      __m128 row_min = _mm_loadu_ps(src_row);
+      __m128 row_max = row_min;
+      for (j = 4; j + 4 <= width; j += 4)
+      {
+        const __m128 val = _mm_loadu_ps(src_row + j);
+        row_min = _mm_min_ps(row_min, val);
+        row_max = _mm_max_ps(row_max, val);
+      }
+
+      alignas(16) float lanes[8];
+      _mm_store_ps(lanes, row_min);
+      _mm_store_ps(lanes + 4, row_max);
+      min_max_row<float>(lanes, 8, min, max);
+    }
+
+    // Remaining pixels.
+    min_max_row<float>(src_row + j, width - j, min, max);
+  }
+
+  CORE_TARGET_AVX2
+  void min_max_row_avx2(float const* src_row, ptrdiff_t width, float& min, float& max)
+  {
+    ptrdiff_t j = 0;
+    if (width >= 8)
+    {
+      __m256 row_min = _mm256_loadu_ps(src_row);
+      __m256 row_max = row_min;
+      for (j = 8; j + 8 <= width; j += 8)
+      {
+        const __m256 val = _mm256_loadu_ps(src_row + j);
+        row_min = _mm256_min_ps(row_min, val);
+        row_max = _mm256_max_ps(row_max, val);
+      }
+
+      alignas(32) float lanes[16];
+      _mm256_store_ps(lanes, row_min);
+      _mm256_store_ps(lanes + 8, row_max);
+      min_max_row<float>(lanes, 16, min, max);
+    }
+
+    // Remaining pixels.
+    min_max_row<float>(src_row + j, width - j, min, max);
+  }
+
+  // The clamping maps NaN to 0 like the scalar template, _mm_max_ps returns its second
+  // operand if one is NaN. The saturating packs then only see values in [0, 255].
+  CORE_TARGET_SSE2
+  void display_gray_row_sse2(float const* src_row, ptrdiff_t width, float offset, float scale, uint8_t* dst_row)
+  {
+    const __m128 off = _mm_set1_ps(offset);
+    const __m128 sc = _mm_set1_ps(scale);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 top = _mm_set1_ps(255.f);
+
+    ptrdiff_t j = 0;
+    for (; j + 16 <= width; j += 16)
+    {
+      __m128i vals[4];
+      for (ptrdiff_t k = 0; k < 4; ++k)
+      {
+        const __m128 val = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(src_row + j + 4 * k), off), sc);
+        vals[k] = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(val, zero), top));
+      }
+
+      const __m128i packed = _mm_packus_epi16(_mm_packs_epi32(vals[0], vals[1]), _mm_packs_epi32(vals[2], vals[3]));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst_row + j), packed);
+    }
+
+    // Remaining pixels.
+    display_gray_row<float>(src_row + j, width - j, offset, scale, dst_row + j);
+  }
+
+  CORE_TARGET_AVX2
+  void display_gray_row_avx2(float const* src_row, ptrdiff_t width, float offset, float scale, uint8_t* dst_row)
+  {
+    const __m256 off = _mm256_set1_ps(offset);
+    const __m256 sc = _mm256_set1_ps(scale);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 top = _mm256_set1_ps(255.f);
+
+    // The packs work within 128 bit lanes, this restores the order of the 4 byte groups.
+    const __m256i lane_order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+    ptrdiff_t j = 0;
+    for (; j + 32 <= width; j += 32)
+    {
+      __m256i vals[4];
+      for (ptrdiff_t k = 0; k < 4; ++k)
+      {
+        const __m256 val = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(src_row + j + 8 * k), off), sc);
+        vals[k] = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(val, zero), top));
+      }
+
+      const __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(vals[0], vals[1]), _mm256_packs_epi32(vals[2], vals[3]));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst_row + j), _mm256_permutevar8x32_epi32(packed, lane_order));
+    }
+
+    // Remaining pixels.
+    display_gray_row<float>(src_row + j, width - j, offset, scale, dst_row + j);
+  }
+
+  CORE_TARGET_SSE2
+  void rgb32_average_row_sse2(uint32_t const* src_row, ptrdiff_t width, float* dst_row)
+  {
+    const __m128i channel = _mm_set1_epi32(0xff);
+    const __m128 third = _mm_set1_ps(0.333333f);
+
+    ptrdiff_t j = 0;
+    for (; j + 4 <= width; j += 4)
+    {
+      const __m128i rgb = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src_row + j));
+      const __m128i sum = _mm_add_epi32(_mm_add_epi32(_mm_and_si128(_mm_srli_epi32(rgb, 16), channel),
+        _mm_and_si128(_mm_srli_epi32(rgb, 8), channel)), _mm_and_si128(rgb, channel));
+
+      _mm_storeu_ps(dst_row + j, _mm_mul_ps(third, _mm_cvtepi32_ps(sum)));
+    }
+
+    // Remaining pixels.
+    rgb32_average_row<float>(src_row + j, width - j, dst_row + j);
+  }
+
+  CORE_TARGET_AVX2
+  void rgb32_average_row_avx2(uint32_t const* src_row, ptrdiff_t width, float* dst_row)
+  {
+    const __m256i channel = _mm256_set1_epi32(0xff);
+    const __m256 third = _mm256_set1_ps(0.333333f);
+
+    ptrdiff_t j = 0;
+    for (; j + 8 <= width; j += 8)
+    {
+      const __m256i rgb = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(src_row + j));
+      const __m256i sum = _mm256_add_epi32(_mm256_add_epi32(_mm256_and_si256(_mm256_srli_epi32(rgb, 16), channel),
+        _mm256_and_si256(_mm256_srli_epi32(rgb, 8), channel)), _mm256_and_si256(rgb, channel));
+
+      _mm256_storeu_ps(dst_row + j, _mm256_mul_ps(third, _mm256_cvtepi32_ps(sum)));
+    }
+
+    // Remaining pixels.
+    rgb32_average_row<float>(src_row + j, width - j, dst_row + j);
+  }
+#endif
+
+  void filter_x_inner_row(float const* src_row, float const* kernel, ptrdiff_t kernel_sz,
+    ptrdiff_t width, float* dst_row)
+  {
+    switch (simd_level())
+    {
+#if defined(CORE_SIMD_X86)
+    case SimdLevel::AVX2:
+      filter_x_inner_row_avx2(src_row, kernel, kernel_sz, width, dst_row);
+      break;
+    case SimdLevel::SSE2:
+      filter_x_inner_row_sse2(src_row, kernel, kernel_sz, width, dst_row);
+      break;
+#endif
+    default:
+      filter_x_inner_row<float>(src_row, kernel, kernel_sz, width, dst_row);
+      break;
+    }
+  }
+
+  void filter_y_inner_row(float const* src_rows, ptrdiff_t src_stride, float const* kernel,
+    ptrdiff_t kernel_sz, ptrdiff_t width, float* dst_row)
+  {
+    switch (simd_level())
+    {
+#if defined(CORE_SIMD_X86)
+    case SimdLevel::AVX2:
+      filter_y_inner_row_avx2(src_rows, src_stride, kernel, kernel_sz, width, dst_row);
+      break;
+    case SimdLevel::SSE2:
+      filter_y_inner_row_sse2(src_rows, src_stride, kernel, kernel_sz, width, dst_row);
+      break;
+#endif
+    default:
+      filter_y_inner_row<float>(src_rows, src_stride, kernel, kernel_sz, width, dst_row);
+      break;
+    }
+  }
+
+  void sobel_inner_row(float const* row_up, float const* row_mid, float const* row_down, ptrdiff_t width,
+    bool squared, float* magnitude_row, float* grad_x_row, float* grad_y_row)
+  {
+    switch (simd_level())
+    {
+#if defined(CORE_SIMD_X86)
+    case SimdLevel::AVX2:
+      sobel_inner_row_avx2(row_up, row_mid, row_down, width, squared, magnitude_row, grad_x_row, grad_y_row);
+      break;
+    case SimdLevel::SSE2:
+      sobel_inner_row_sse2(row_up, row_mid, row_down, width, squared, magnitude_row, grad_x_row, grad_y_row);
+      break;
+#endif
+    default:
+      sobel_inner_row<float>(row_up, row_mid, row_down, width, squared, magnitude_row, grad_x_row, grad_y_row);
+      break;
+    }
+  }
+
+  void gradient_direction_row(float const* grad_x_row, float const* grad_y_row, ptrdiff_t width, int8_t* dst_row)
+  {
+    switch (simd_level())
+    {
+#if defined(CORE_SIMD_X86)
+    case SimdLevel::AVX2:
+      gradient_direction_row_avx2(grad_x_row, grad_y_row, width, dst_row);
+      break;
+    case SimdLevel::SSE2:
+      gradient_direction_row_sse2(grad_x_row, grad_y_row, width, dst_row);
+      break;
+#endif
+    default:
+      gradient_direction_row<float>(grad_x_row, grad_y_row, width, dst_row);
+      break;
+    }
+  }
+
+  void threshold_pack_row(float const* src_row, ptrdiff_t width, float threshold, uint64_t* dst_row)
+  {
+    switch (simd_level())
+    {
+#if defined(CORE_SIMD_X86)
+    case SimdLevel::AVX2:
+      threshold_pack_row_avx2(src_row, width, threshold, dst_row);
+      break;
+    case SimdLevel::SSE2:
+      threshold_pack_row_sse2(src_row, width, threshold, dst_row);
+      break;
+#endif
+    default:
+      threshold_pack_row<float>(src_row, width, threshold, dst_row);
+      break;
+    }
+  }
+
+  void min_max_row(float const* src_row, ptrdiff_t width, float& min, float& max)
+  {
+    switch (simd_level())
+    {
+#if defined(CORE_SIMD_X86)
+    case SimdLevel::AVX2:
+      min_max_row_avx2(src_row, width, min, max);
+      break;
+    case SimdLevel::SSE2:
+      min_max_row_sse2(src_row, width, min, max);
+      break;
+#endif
+    default:
+      min_max_row<float>(src_row, width, min, max);
+      break;
+    }
+  }
+
+  void display_gray_row(float const* src_row, ptrdiff_t width, float offset, float scale, uint8_t* dst_row)
+  {
+    switch (simd_level())
+    {
+#if defined(CORE_SIMD_X86)
+    case SimdLevel::AVX2:
+      display_gray_row_avx2(src_row, width, offset, scale, dst_row);
+      break;
+    case SimdLevel::SSE2:
+      display_gray_row_sse2(src_row, width, offset, scale, dst_row);
+      break;
+#endif
+    default:
+      display_gray_row<float>(src_row, width, offset, scale, dst_row);
+      break;
+    }
+  }
+
+  void rgb32_average_row(uint32_t const* src_row, ptrdiff_t width, float* dst_row)
+  {
+    switch (simd_level())
+    {
+#if defined(CORE_SIMD_X86)
+    case SimdLevel::AVX2:
+      rgb32_average_row_avx2(src_row, width, dst_row);
+      break;
+    case SimdLevel::SSE2:
+      rgb32_average_row_sse2(src_row, width, dst_row);
+      break;
+#endif
+    default:
+      rgb32_average_row<float>(src_row, width, dst_row);
+      break;
+    }
+  }
+}
+
+void set_max_simd_level(SimdLevel level)
+{
+  detail::max_simd_level = level;
+}
+
+SimdLevel simd_level()
+{
+  static const auto supported = detail::supported_simd_level();
+  const auto max_level = detail::max_simd_level.load();
+  return max_level < supported ? max_level : supported;
+}
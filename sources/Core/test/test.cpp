@@ -1,6 +1,20 @@
 #include <gtest/gtest.h>
 
+#include <Core/BinaryImage.hpp>
 #include <Core/Core.hpp>
+#include <Core/ImageIO.hpp>
+#include <Core/Serialization.hpp>
+
+#include <chrono>
+#include <fstream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
 
 TEST(Image2dBasicTest, ConstructionTest)
 {
@@ -26,6 +40,42 @@ TEST(Image2dBasicTest, AccessArrayElements)
       ASSERT_EQ(img(i, j), i * w + j);
 }
 
+TEST(Image2dBasicTest, RowsAreAligned)
+{
+  const ptrdiff_t h = 20;
+  const ptrdiff_t w = 10;
+  Image2d<float> img(h, w);
+  ASSERT_GE(img.stride(), w);
+  ASSERT_EQ(img.stride() * sizeof(float) % detail::image_row_alignment, 0);
+
+  for (ptrdiff_t i = 0; i < h; ++i)
+  {
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(img.row(i)) % detail::image_row_alignment, 0);
+    ASSERT_EQ(img.row(i), &img(i, 0));
+  }
+
+  // Padding is added on top of the row width before aligning the stride.
+  Image2d<unsigned char> padded(h, 1024, 64);
+  ASSERT_EQ(padded.stride(), 1024 + 64);
+}
+
+TEST(Image2dBasicTest, UninitializedAllocation)
+{
+  const ptrdiff_t h = 20;
+  const ptrdiff_t w = 10;
+  Image2d<float> img(h, w, no_init);
+  ASSERT_NE(img.data(), nullptr);
+  ASSERT_EQ(img.height(), h);
+  ASSERT_EQ(img.width(), w);
+  ASSERT_EQ(img.stride(), Image2d<float>(h, w).stride());
+
+  img.allocUninitialized(2 * h, w);
+  ASSERT_EQ(img.height(), 2 * h);
+  fill(img, 3.f);
+  foreach2d(img, y, x)
+    ASSERT_EQ(img(y, x), 3.f);
+}
+
 TEST(Image2dBasicTest, Foreach2dLoopTest)
 {
   const ptrdiff_t h = 20;
@@ -155,6 +205,646 @@ TEST(FilterFunctionTest, TestwrapBoundaryConditionInYdir)
   }
 }
 
+namespace detail
+{
+  template<typename T>
+  void fill_random(Image2d<T>& dst, unsigned seed)
+  {
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<float> dist(0.f, 255.f);
+    foreach2d(dst, y, x)
+      dst(y, x) = T(dist(gen));
+  }
+
+  template<typename T>
+  bool are_identical(Image2d<T> const& img1, Image2d<T> const& img2)
+  {
+    if (img1.size().y != img2.size().y || img1.size().x != img2.size().x)
+      return false;
+
+    foreach2d(img1, y, x)
+    {
+      if (img1(y, x) != img2(y, x))
+        return false;
+    }
+
+    return true;
+  }
+
+  // Limits the threads for the scope of a test, restoring the previous limit on exit
+  // (failing ASSERTs return early).
+  class ScopedMaxThreads
+  {
+  public:
+    explicit ScopedMaxThreads(size_t n) : prev_(max_threads()) { set_max_threads(n); }
+    ~ScopedMaxThreads() { set_max_threads(prev_); }
+
+  private:
+    size_t prev_;
+  };
+}
+
+TEST(FilterFunctionTest, ParallelFilterMatchesSerial)
+{
+  const ptrdiff_t h = 300;
+  const ptrdiff_t w = 257;
+  Image2d<float> src(h, w);
+  detail::fill_random(src, 42);
+
+  const float kernel[] = { 0.1f, 0.2f, 0.4f, 0.2f, 0.1f, 0.3f, 0.7f };
+  const ptrdiff_t kernel_sz = 7;
+
+  for (auto bc : { BorderCondition::BC_ZERO, BorderCondition::BC_CLAMP, BorderCondition::BC_WRAP })
+  {
+    Image2d<float> serial_x(h, w), serial_y(h, w);
+    set_max_threads(1);
+    filter_x(src, kernel, kernel_sz, bc, serial_x);
+    filter_y(src, kernel, kernel_sz, bc, serial_y);
+
+    Image2d<float> parallel_x(h, w), parallel_y(h, w);
+    set_max_threads(4);
+    filter_x(src, kernel, kernel_sz, bc, parallel_x);
+    filter_y(src, kernel, kernel_sz, bc, parallel_y);
+
+    ASSERT_TRUE(detail::are_identical(serial_x, parallel_x));
+    ASSERT_TRUE(detail::are_identical(serial_y, parallel_y));
+  }
+
+  set_max_threads(0);
+}
+
+TEST(FilterFunctionTest, PaddedRowsGiveSameResult)
+{
+  const ptrdiff_t h = 40;
+  const ptrdiff_t w = 64;
+  Image2d<float> src(h, w), padded_src(h, w, 16);
+  detail::fill_random(src, 3);
+  fill(padded_src, src);
+
+  Image2d<float> filt(h, w), padded_filt(h, w, 16);
+  gauss_filter(src, 3, 3, 1.5f, 1.5f, BorderCondition::BC_CLAMP, filt);
+  gauss_filter(padded_src, 3, 3, 1.5f, 1.5f, BorderCondition::BC_CLAMP, padded_filt);
+
+  ASSERT_TRUE(detail::are_identical(filt, padded_filt));
+}
+
+TEST(FilterFunctionTest, SimdFilterMatchesScalar)
+{
+  const ptrdiff_t h = 37;
+  const ptrdiff_t w = 61;
+  Image2d<float> src(h, w);
+  detail::fill_random(src, 7);
+
+  Image2d<float> kernel;
+  detail::create_gauss_kernel(ptrdiff_t(4), 2.f, kernel);
+
+  for (auto bc : { BorderCondition::BC_ZERO, BorderCondition::BC_CLAMP, BorderCondition::BC_WRAP })
+  {
+    Image2d<float> scalar_x(h, w), scalar_y(h, w);
+    set_max_simd_level(SimdLevel::Scalar);
+    filter_x(src, kernel.data(), kernel.width(), bc, scalar_x);
+    filter_y(src, kernel.data(), kernel.width(), bc, scalar_y);
+
+    for (auto level : { SimdLevel::SSE2, SimdLevel::AVX2 })
+    {
+      Image2d<float> simd_x(h, w), simd_y(h, w);
+      set_max_simd_level(level);
+      filter_x(src, kernel.data(), kernel.width(), bc, simd_x);
+      filter_y(src, kernel.data(), kernel.width(), bc, simd_y);
+
+      ASSERT_TRUE(detail::are_identical(scalar_x, simd_x));
+      ASSERT_TRUE(detail::are_identical(scalar_y, simd_y));
+    }
+  }
+
+  set_max_simd_level(SimdLevel::AVX2);
+}
+
+TEST(FilterFunctionTest, SimdDisplayConversionsMatchScalar)
+{
+  // Wider than a few vectors, with remaining pixels at every SIMD level.
+  const ptrdiff_t h = 29;
+  const ptrdiff_t w = 75;
+  Image2d<float> src(h, w);
+  detail::fill_random(src, 13);
+  src(17, 70) = -40.f;
+  src(3, 5) = 400.f;
+
+  Image2d<uint32_t> rgb(h, w);
+  foreach2d(rgb, y, x)
+  {
+    rgb(y, x) = 0xff000000u | uint32_t(x * 3 % 256) << 16 | uint32_t(y * 7 % 256) << 8 | uint32_t((x + y) % 256);
+  }
+
+  set_max_simd_level(SimdLevel::Scalar);
+  const auto [scalar_min, scalar_max] = min_max_value(src);
+  ASSERT_EQ(scalar_min, min_value(src));
+  ASSERT_EQ(scalar_max, max_value(src));
+
+  // A range narrower than the values, so that both sides are clamped.
+  Image2d<unsigned char> scalar_display(h, w);
+  to_display_gray(src.view(), 10.f, 200.f, scalar_display.view());
+
+  Image2d<float> scalar_gray(h, w);
+  rgb32_to_gray(rgb.view(), scalar_gray.view());
+
+  for (auto level : { SimdLevel::SSE2, SimdLevel::AVX2 })
+  {
+    set_max_simd_level(level);
+    const auto [simd_min, simd_max] = min_max_value(src);
+    ASSERT_EQ(scalar_min, simd_min);
+    ASSERT_EQ(scalar_max, simd_max);
+
+    Image2d<unsigned char> simd_display(h, w);
+    to_display_gray(src.view(), 10.f, 200.f, simd_display.view());
+    ASSERT_TRUE(detail::are_identical(scalar_display, simd_display));
+
+    Image2d<float> simd_gray(h, w);
+    rgb32_to_gray(rgb.view(), simd_gray.view());
+    ASSERT_TRUE(detail::are_identical(scalar_gray, simd_gray));
+  }
+
+  set_max_simd_level(SimdLevel::AVX2);
+  ASSERT_EQ(scalar_display(17, 70), 0);
+  ASSERT_EQ(scalar_display(3, 5), 255);
+
+  // A constant image maps to 0.
+  Image2d<float> constant(h, w);
+  fill(constant, 5.f);
+  to_display_gray(constant.view(), 5.f, 5.f, scalar_display.view());
+  ASSERT_EQ(scalar_display(0, 0), 0);
+}
+
+TEST(FilterFunctionTest, RunningSumBoxFilterMatchesKernelFilter)
+{
+  const ptrdiff_t h = 90;
+  const ptrdiff_t w = 70;
+  Image2d<float> src(h, w);
+  detail::fill_random(src, 5);
+
+  Image2d<int> src_int(h, w);
+  fill(src_int, src);
+
+  for (auto bc : { BorderCondition::BC_ZERO, BorderCondition::BC_CLAMP, BorderCondition::BC_WRAP })
+  {
+    // The largest kernel exceeds the image in both directions.
+    for (ptrdiff_t radius : { 1, 4, 25, 60 })
+    {
+      const auto kernel_sz = 2 * radius + 1;
+      std::vector<float> kernel(kernel_sz, 1.f);
+      std::vector<int> kernel_int(kernel_sz, 1);
+
+      Image2d<float> expected_x(h, w), expected_y(h, w), box_x(h, w), box_y(h, w);
+      filter_x(src, kernel.data(), kernel_sz, bc, expected_x);
+      filter_y(src, kernel.data(), kernel_sz, bc, expected_y);
+      box_filter_x(src, radius, bc, box_x);
+      box_filter_y(src, radius, bc, box_y);
+
+      foreach2d(src, y, x)
+      {
+        ASSERT_NEAR(expected_x(y, x), box_x(y, x), 1e-5f * std::abs(expected_x(y, x)) + 1e-3f);
+        ASSERT_NEAR(expected_y(y, x), box_y(y, x), 1e-5f * std::abs(expected_y(y, x)) + 1e-3f);
+      }
+
+      // Integer sums are exact.
+      Image2d<int> expected_int(h, w), box_int(h, w);
+      filter_y(src_int, kernel_int.data(), kernel_sz, bc, expected_int);
+      box_filter_y(src_int, radius, bc, box_int);
+      ASSERT_TRUE(detail::are_identical(expected_int, box_int));
+
+      filter_x(src_int, kernel_int.data(), kernel_sz, bc, expected_int);
+      box_filter_x(src_int, radius, bc, box_int);
+      ASSERT_TRUE(detail::are_identical(expected_int, box_int));
+    }
+  }
+}
+
+TEST(FilterFunctionTest, DownscaleBoxAveragesBlocks)
+{
+  const ptrdiff_t h = 23;
+  const ptrdiff_t w = 17;
+  Image2d<float> src(h, w);
+  detail::fill_random(src, 9);
+
+  for (ptrdiff_t factor : { 1, 2, 4, 5 })
+  {
+    Image2d<float> dst;
+    downscale_box(src, factor, dst);
+    ASSERT_EQ(dst.height(), (h + factor - 1) / factor);
+    ASSERT_EQ(dst.width(), (w + factor - 1) / factor);
+
+    // The partial blocks at the borders average fewer pixels.
+    foreach2d(dst, y, x)
+    {
+      float sum = 0.f;
+      int count = 0;
+      for (auto src_y = y * factor; src_y < std::min(h, (y + 1) * factor); ++src_y)
+        for (auto src_x = x * factor; src_x < std::min(w, (x + 1) * factor); ++src_x)
+        {
+          sum += src(src_y, src_x);
+          ++count;
+        }
+
+      ASSERT_NEAR(dst(y, x), sum / float(count), 1e-3f);
+    }
+  }
+}
+
+TEST(FilterFunctionTest, PyramidLevelsAreDecimatedGaussFilters)
+{
+  // Odd sizes, so that the last rows and columns of the levels hit the clamped border.
+  const ptrdiff_t h = 41;
+  const ptrdiff_t w = 27;
+  Image2d<float> src(h, w);
+  detail::fill_random(src, 11);
+
+  GaussPyramid pyramid(src.view(), 10);
+  ASSERT_EQ(pyramid.levels(), 7u);
+  ASSERT_EQ(pyramid.level(6).height(), 1);
+  ASSERT_EQ(pyramid.level(6).width(), 1);
+
+  Image2d<float> finer(h, w);
+  fill(finer, src);
+  for (size_t i = 1; i < pyramid.levels(); ++i)
+  {
+    Image2d<float> blurred(finer.height(), finer.width());
+    gauss_filter(finer, 2, 2, 1.f, 1.f, BorderCondition::BC_CLAMP, blurred);
+
+    const auto level = pyramid.level(i);
+    ASSERT_EQ(level.height(), (finer.height() + 1) / 2);
+    ASSERT_EQ(level.width(), (finer.width() + 1) / 2);
+
+    Image2d<float> coarser(level.height(), level.width());
+    foreach2d(coarser, y, x)
+    {
+      ASSERT_NEAR(level(y, x), blurred(2 * y, 2 * x), 1e-3f);
+      coarser(y, x) = level(y, x);
+    }
+
+    finer = std::move(coarser);
+  }
+
+  // Executing on a level is executing on the level image.
+  OperationChain chain;
+  chain.addOperation(0, FilterConfig{ 1, 1, 1.f, 1.f });
+  chain.addOperation(1, ThresholdConfig{ 128.f, 255.f, 0.f });
+
+  Image2d<float> level_img(pyramid.level(2).height(), pyramid.level(2).width());
+  fill(level_img.view(), pyramid.level(2));
+
+  Image2d<float> expected, dst;
+  chain.executeChain(level_img, expected);
+  chain.executeChain(pyramid, 2, dst);
+  ASSERT_TRUE(detail::are_identical(expected, dst));
+}
+
+TEST(SobelTest, FusedGradientMatchesSeparableFilters)
+{
+  const ptrdiff_t h = 90;
+  const ptrdiff_t w = 131;
+  Image2d<float> src(h, w);
+  detail::fill_random(src, 5);
+
+  for (const auto bc : { BorderCondition::BC_ZERO, BorderCondition::BC_CLAMP, BorderCondition::BC_WRAP })
+  {
+    Image2d<float> grad_x(h, w);
+    Image2d<float> grad_y(h, w);
+    sobel_x(src, bc, grad_x);
+    sobel_y(src, bc, grad_y);
+
+    Image2d<float> magnitude(h, w);
+    Image2d<float> magnitude_sq(h, w);
+    Image2d<int8_t> directions(h, w);
+    sobel_gradient(src, bc, GradientNorm::L2, magnitude);
+    sobel_gradient(src, bc, GradientNorm::SquaredL2, magnitude_sq, directions);
+
+    foreach2d(src, y, x)
+    {
+      const auto gx = grad_x(y, x);
+      const auto gy = grad_y(y, x);
+      const auto sq = gx * gx + gy * gy;
+      ASSERT_NEAR(magnitude_sq(y, x), sq, 1e-5f * sq);
+      ASSERT_NEAR(magnitude(y, x), std::sqrt(sq), 1e-3f);
+
+      // Gradients near a bin boundary may round differently.
+      const double angle = (gx == 0.f) ? constants::half_pi : std::atan2(gy, gx);
+      const double to_boundary = std::fmod(std::abs(angle) + constants::eighth_pi, constants::quarter_pi);
+      if (to_boundary > 1e-3 && to_boundary < constants::quarter_pi - 1e-3)
+      {
+        ASSERT_EQ(directions(y, x), detail::canny_get_angle_bin(angle));
+      }
+    }
+  }
+
+  // The vectorized kernels are exact.
+  Image2d<float> scalar(h, w);
+  Image2d<int8_t> scalar_directions(h, w);
+  set_max_simd_level(SimdLevel::Scalar);
+  sobel_gradient(src, BorderCondition::BC_CLAMP, GradientNorm::L2, scalar, scalar_directions);
+
+  for (const auto level : { SimdLevel::SSE2, SimdLevel::AVX2 })
+  {
+    Image2d<float> vectorized(h, w);
+    Image2d<int8_t> vectorized_directions(h, w);
+    set_max_simd_level(level);
+    sobel_gradient(src, BorderCondition::BC_CLAMP, GradientNorm::L2, vectorized, vectorized_directions);
+
+    ASSERT_TRUE(detail::are_identical(scalar, vectorized));
+    ASSERT_TRUE(detail::are_identical(scalar_directions, vectorized_directions));
+  }
+  set_max_simd_level(SimdLevel::AVX2);
+}
+
+TEST(SobelTest, DirectionBinsMatchAngleBins)
+{
+  const ptrdiff_t n = 100003;
+  std::mt19937 gen(11);
+  std::uniform_real_distribution<float> dist(-1000.f, 1000.f);
+
+  // Random gradients, including axis-aligned and diagonal ones and zeros.
+  std::vector<float> grad_x(n);
+  std::vector<float> grad_y(n);
+  for (ptrdiff_t i = 0; i < n; ++i)
+  {
+    grad_x[i] = dist(gen);
+    grad_y[i] = dist(gen);
+    switch (i % 16)
+    {
+    case 0: grad_x[i] = 0.f; break;
+    case 1: grad_y[i] = 0.f; break;
+    case 2: grad_y[i] = -grad_x[i]; break;
+    case 3: grad_y[i] = grad_x[i]; break;
+    case 4: grad_x[i] = grad_y[i] = 0.f; break;
+    case 5: grad_y[i] = -0.f; break;
+    default: break;
+    }
+  }
+
+  std::vector<int8_t> expected(n);
+  for (ptrdiff_t i = 0; i < n; ++i)
+  {
+    const auto gx = grad_x[i];
+    const auto gy = grad_y[i];
+    const double angle = (gx == 0.f) ? constants::half_pi : std::atan2(gy, gx);
+    expected[i] = detail::canny_get_angle_bin(angle);
+  }
+
+  for (const auto level : { SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2 })
+  {
+    set_max_simd_level(level);
+
+    std::vector<int8_t> bins(n);
+    detail::gradient_direction_row(grad_x.data(), grad_y.data(), n, bins.data());
+    for (ptrdiff_t i = 0; i < n; ++i)
+      ASSERT_EQ(bins[i], expected[i]) << "gx " << grad_x[i] << ", gy " << grad_y[i];
+  }
+  set_max_simd_level(SimdLevel::AVX2);
+}
+
+namespace detail
+{
+  // Straightforward edge tracking, the reference of the optimized versions.
+  void reference_hysteresis_edge_tracking(Image2d<unsigned char>& dst)
+  {
+    const std::vector<Position> moore_neighbors = {
+      Position(-1, -1), Position(-1, 0), Position(-1, 1), Position(0, 1),
+      Position(1, 1), Position(1, 0), Position(1, -1), Position(0, -1) };
+
+    foreach2d(dst, y, x)
+    {
+      if (dst(y, x) != 2)
+        continue;
+
+      dst(y, x) = 255;
+      std::vector<Position> hysteresis = { Position(y, x) };
+      while (!hysteresis.empty())
+      {
+        const auto curr = hysteresis.back();
+        hysteresis.pop_back();
+
+        for (const auto nbh : moore_neighbors)
+        {
+          const auto nbh_pos = curr + nbh;
+          if (dst.isValid(nbh_pos) && dst(nbh_pos) == 1)
+          {
+            dst(nbh_pos) = 255;
+            hysteresis.push_back(nbh_pos);
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST(HysteresisTest, SerialAndParallelTrackingMatchReference)
+{
+  const ptrdiff_t h = 203;
+  const ptrdiff_t w = 157;
+
+  // Dense weak pixels give edges spanning many bands, sparse ones leave unconnected weak pixels.
+  std::mt19937 gen(23);
+  for (const double weak_weight : { 48., 25. })
+  {
+    std::discrete_distribution<int> dist({ 98. - weak_weight, weak_weight, 2. });
+    Image2d<unsigned char> marks(h, w);
+    foreach2d(marks, y, x)
+      marks(y, x) = static_cast<unsigned char>(dist(gen));
+
+    Image2d<unsigned char> expected(h, w);
+    fill(expected, marks);
+    detail::reference_hysteresis_edge_tracking(expected);
+
+    Image2d<unsigned char> serial(h, w);
+    fill(serial, marks);
+    detail::hysteresis_edge_tracking_serial(serial.view());
+    ASSERT_TRUE(detail::are_identical(serial, expected));
+
+    set_max_threads(4);
+    for (const ptrdiff_t n_bands : { ptrdiff_t(1), ptrdiff_t(2), ptrdiff_t(3), ptrdiff_t(7), ptrdiff_t(64), h })
+    {
+      Image2d<unsigned char> parallel(h, w);
+      fill(parallel, marks);
+      detail::hysteresis_edge_tracking_parallel(parallel.view(), n_bands);
+      ASSERT_TRUE(detail::are_identical(parallel, expected)) << n_bands << " bands";
+    }
+    set_max_threads(0);
+  }
+}
+
+TEST(HysteresisTest, CancelledTrackingStopsSafely)
+{
+  const ptrdiff_t h = 512;
+  const ptrdiff_t w = 384;
+  detail::ScopedMaxThreads threads(4);
+
+  Image2d<unsigned char> marks(h, w);
+  fill(marks, static_cast<unsigned char>(1));
+  marks(h / 2, w / 2) = 2;
+
+  // Leave invalid parent indices in the pool, where the forest takes its buffer from.
+  {
+    ScratchImage<int32_t> garbage(h, w);
+    fill(garbage.view(), std::numeric_limits<int32_t>::max());
+  }
+
+  // Cancelled before the bands are labelled, the tracking has to stop before merging them.
+  std::atomic<bool> flag{ true };
+  Image2d<unsigned char> tracked(h, w);
+  fill(tracked, marks);
+  {
+    CancellationScope scope(flag);
+    detail::hysteresis_edge_tracking_parallel(tracked.view(), 4);
+  }
+  ASSERT_TRUE(detail::are_identical(tracked, marks));
+
+  // Cancelled at some point of a Canny run.
+  Image2d<float> src(h, w);
+  detail::fill_random(src, 37);
+  Image2d<unsigned char> canny(h, w);
+
+  flag = false;
+  std::thread canceller([&]()
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+      flag = true;
+    });
+  {
+    CancellationScope scope(flag);
+    for (int run = 0; run < 1000 && !flag; ++run)
+      canny_edge_detection(src, 1.f, 2.f, canny);
+    canny_edge_detection(src, 1.f, 2.f, canny);
+  }
+  canceller.join();
+}
+
+TEST(GaussFilterTest, RecursiveFilterApproximatesKernelFilter)
+{
+  const ptrdiff_t h = 240;
+  const ptrdiff_t w = 320;
+  Image2d<float> src(h, w);
+  detail::fill_random(src, 29);
+
+  // A constant image has to stay constant, borders included.
+  Image2d<float> constant(h, w);
+  Image2d<float> constant_filtered(h, w);
+  fill(constant, 100.f);
+  gauss_filter_iir(constant, 4.f, 4.f, constant_filtered);
+  foreach2d(constant_filtered, y, x)
+    ASSERT_NEAR(constant_filtered(y, x), 100.f, 1e-3f);
+
+  // Maximum and mean absolute deviation from the FIR filter on uniform noise in
+  // [0, 255], the worst case for the recursive approximation.
+  const std::vector<std::tuple<float, double, double>> sigma_tolerances = {
+    { 1.f, 16., 3.5 }, { 3.f, 3., 0.5 }, { 8.f, 1.5, 0.2 }, { 20.f, 1., 0.1 } };
+
+  set_max_threads(4);
+  for (const auto& [sigma, max_tolerance, mean_tolerance] : sigma_tolerances)
+  {
+    // A kernel of 5 sigma is exact within float precision.
+    const auto radius = ptrdiff_t(std::ceil(5.f * sigma));
+    Image2d<float> fir(h, w);
+    Image2d<float> iir(h, w);
+    gauss_filter(src, radius, radius, sigma, sigma, BorderCondition::BC_CLAMP, fir);
+    gauss_filter_iir(src, sigma, sigma, iir);
+
+    double max_error = 0.;
+    double mean_error = 0.;
+    foreach2d(fir, y, x)
+    {
+      const double error = std::abs(double(fir(y, x)) - double(iir(y, x)));
+      max_error = std::max(max_error, error);
+      mean_error += error;
+    }
+    mean_error /= double(h * w);
+
+    RecordProperty("max_error_sigma_" + std::to_string(int(sigma)), std::to_string(max_error));
+    RecordProperty("mean_error_sigma_" + std::to_string(int(sigma)), std::to_string(mean_error));
+    EXPECT_LT(max_error, max_tolerance) << "sigma " << sigma;
+    EXPECT_LT(mean_error, mean_tolerance) << "sigma " << sigma;
+  }
+  set_max_threads(0);
+}
+
+TEST(IntegralImageTest, RectangleSumsMatchDirectSums)
+{
+  const ptrdiff_t h = 300;
+  const ptrdiff_t w = 200;
+  Image2d<unsigned char> src(h, w);
+  detail::fill_random(src, 17);
+
+  set_max_threads(4);
+  IntegralImage<unsigned char> integral(src);
+  set_max_threads(0);
+
+  static_assert(std::is_same_v<IntegralImage<unsigned char>::value_type, uint64_t>);
+  ASSERT_EQ(integral.height(), h);
+  ASSERT_EQ(integral.width(), w);
+
+  std::mt19937 gen(3);
+  for (int n = 0; n < 200; ++n)
+  {
+    const auto y = ptrdiff_t(gen() % h);
+    const auto x = ptrdiff_t(gen() % w);
+    const auto rect_h = ptrdiff_t(gen() % (h - y)) + 1;
+    const auto rect_w = ptrdiff_t(gen() % (w - x)) + 1;
+
+    uint64_t expected = 0;
+    for (ptrdiff_t i = y; i < y + rect_h; ++i)
+      for (ptrdiff_t j = x; j < x + rect_w; ++j)
+        expected += src(i, j);
+
+    ASSERT_EQ(integral.sum(y, x, rect_h, rect_w), expected);
+  }
+
+  // Whole image and empty rectangles.
+  Image2d<int64_t> table;
+  Image2d<int> ones(h, w);
+  fill(ones, 1);
+  integral_image(ones, table);
+  ASSERT_EQ(rect_sum(table, 0, 0, h, w), h * w);
+  ASSERT_EQ(rect_sum(table, 10, 10, 0, 5), 0);
+}
+
+TEST(ImageViewTest, RoiAccessesParentPixels)
+{
+  Image2d<int> img(20, 10);
+  foreach2d(img, y, x)
+    img(y, x) = int(y * 10 + x);
+
+  const auto roi = img.view().roi(5, 2, 4, 3);
+  ASSERT_EQ(roi.height(), 4);
+  ASSERT_EQ(roi.width(), 3);
+  ASSERT_EQ(roi.stride(), img.stride());
+  foreach2d(roi, y, x)
+    ASSERT_EQ(roi(y, x), img(y + 5, x + 2));
+
+  // Writing through the view modifies the parent image.
+  fill(roi, -1);
+  ASSERT_EQ(img(5, 2), -1);
+  ASSERT_EQ(img(8, 4), -1);
+  ASSERT_EQ(img(4, 2), 42);
+  ASSERT_EQ(img(5, 5), 55);
+}
+
+TEST(ImageViewTest, FilterOnRoiMatchesCopy)
+{
+  Image2d<float> src(60, 50);
+  detail::fill_random(src, 11);
+
+  const auto roi = src.view().roi(10, 7, 30, 33);
+  Image2d<float> roi_copy(roi.size());
+  fill(roi_copy.view(), roi);
+
+  Image2d<float> expected(roi.size());
+  gauss_filter(roi_copy, 2, 3, 1.f, 1.5f, BorderCondition::BC_WRAP, expected);
+
+  Image2d<float> result(60, 50);
+  gauss_filter(roi, 2, 3, 1.f, 1.5f, BorderCondition::BC_WRAP, result.view().roi(10, 7, 30, 33));
+
+  foreach2d(expected, y, x)
+    ASSERT_EQ(expected(y, x), result(y + 10, x + 7));
+}
+
 TEST(MorphologicalFunctionTest, TestErosion)
 {
   // Small 5x5 image with 3x3 square in the center.
@@ -173,6 +863,168 @@ TEST(MorphologicalFunctionTest, TestErosion)
   eroded(2, 2) = 0;
   foreach2d(eroded, y, x)
     ASSERT_EQ(eroded(y, x), 0);
+
+  // Masks of other values, like the 0/255 Canny output, give 0/1 as well.
+  Image2d<unsigned char> mask(5, 5);
+  fill(mask, (unsigned char)0);
+  for (int i = 1; i < 4; ++i)
+    for (int j = 1; j < 4; ++j)
+      mask(i, j) = 255;
+
+  Image2d<unsigned char> eroded_mask(5, 5);
+  erode(mask, 1, eroded_mask);
+  foreach2d(eroded_mask, y, x)
+    ASSERT_EQ(eroded_mask(y, x), y == 2 && x == 2 ? 1 : 0);
+}
+
+TEST(MorphologicalFunctionTest, MinMaxFiltersMatchBruteForce)
+{
+  const ptrdiff_t h = 67;
+  const ptrdiff_t w = 93;
+  Image2d<int> src(h, w);
+  detail::fill_random(src, 31);
+  Image2d<float> src_float(h, w);
+  detail::fill_random(src_float, 37);
+
+  const auto brute_force = [](auto const& img, ptrdiff_t ry, ptrdiff_t rx, BorderCondition bc, bool is_max)
+  {
+    using T = std::decay_t<decltype(img(0, 0))>;
+    Image2d<T> result(img.height(), img.width());
+    foreach2d(result, y, x)
+    {
+      std::optional<T> extremum;
+      for (ptrdiff_t ik = -ry; ik <= ry; ++ik)
+        for (ptrdiff_t jk = -rx; jk <= rx; ++jk)
+        {
+          const auto i = detail::border_index(y + ik, img.height(), bc);
+          const auto j = detail::border_index(x + jk, img.width(), bc);
+          const T val = (i < 0 || j < 0) ? T(0) : img(i, j);
+          if (!extremum || (is_max ? val > *extremum : val < *extremum))
+            extremum = val;
+        }
+      result(y, x) = *extremum;
+    }
+    return result;
+  };
+
+  detail::ScopedMaxThreads threads(4);
+  for (const auto bc : { BorderCondition::BC_ZERO, BorderCondition::BC_CLAMP, BorderCondition::BC_WRAP })
+    for (const auto& [ry, rx] : { std::pair<ptrdiff_t, ptrdiff_t>(0, 0), { 1, 2 }, { 4, 3 }, { 12, 7 } })
+    {
+      Image2d<int> eroded(h, w);
+      Image2d<int> dilated(h, w);
+      erode(src, ry, rx, bc, eroded);
+      dilate(src, ry, rx, bc, dilated);
+      ASSERT_TRUE(detail::are_identical(eroded, brute_force(src, ry, rx, bc, false)));
+      ASSERT_TRUE(detail::are_identical(dilated, brute_force(src, ry, rx, bc, true)));
+
+      Image2d<float> eroded_float(h, w);
+      erode(src_float, ry, rx, bc, eroded_float);
+      ASSERT_TRUE(detail::are_identical(eroded_float, brute_force(src_float, ry, rx, bc, false)));
+
+      // Opening and closing compose the two.
+      Image2d<int> opened(h, w);
+      Image2d<int> expected_opened(h, w);
+      morph_open(src, ry, rx, bc, opened);
+      dilate(eroded, ry, rx, bc, expected_opened);
+      ASSERT_TRUE(detail::are_identical(opened, expected_opened));
+
+      Image2d<int> closed(h, w);
+      Image2d<int> expected_closed(h, w);
+      morph_close(src, ry, rx, bc, closed);
+      erode(dilated, ry, rx, bc, expected_closed);
+      ASSERT_TRUE(detail::are_identical(closed, expected_closed));
+    }
+}
+
+TEST(BinaryImageTest, ThresholdAndLogicalOperationsMatchImages)
+{
+  const ptrdiff_t h = 37;
+  const ptrdiff_t w = 150;
+  Image2d<float> src1(h, w);
+  Image2d<float> src2(h, w);
+  detail::fill_random(src1, 3);
+  detail::fill_random(src2, 4);
+
+  Image2d<unsigned char> expected1(h, w);
+  Image2d<unsigned char> expected2(h, w);
+  threshold_image(src1.view(), 128.f, 1, 0, expected1.view());
+  threshold_image(src2.view(), 64.f, 1, 0, expected2.view());
+
+  for (const auto level : { SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2 })
+  {
+    set_max_simd_level(level);
+
+    BinaryImage mask1;
+    threshold_image(src1, 128.f, mask1);
+    Image2d<unsigned char> unpacked;
+    from_binary(mask1, 1, 0, unpacked);
+    ASSERT_TRUE(detail::are_identical(unpacked, expected1));
+  }
+  set_max_simd_level(SimdLevel::AVX2);
+
+  BinaryImage mask1;
+  BinaryImage mask2;
+  to_binary(expected1, mask1);
+  to_binary(expected2, mask2);
+
+  size_t n_set = 0;
+  foreach2d(expected1, y, x)
+    n_set += expected1(y, x);
+  ASSERT_EQ(mask1.count(), n_set);
+
+  BinaryImage and_mask, or_mask, xor_mask, not_mask;
+  binary_and(mask1, mask2, and_mask);
+  binary_or(mask1, mask2, or_mask);
+  binary_xor(mask1, mask2, xor_mask);
+  binary_not(mask1, not_mask);
+  foreach2d(expected1, y, x)
+  {
+    const bool a = expected1(y, x) != 0;
+    const bool b = expected2(y, x) != 0;
+    ASSERT_EQ(and_mask(y, x), a && b);
+    ASSERT_EQ(or_mask(y, x), a || b);
+    ASSERT_EQ(xor_mask(y, x), a != b);
+    ASSERT_EQ(not_mask(y, x), !a);
+  }
+
+  // The bits past the width stay clear.
+  ASSERT_EQ(not_mask.count(), size_t(h * w) - n_set);
+}
+
+TEST(BinaryImageTest, MorphologyMatchesImageMorphology)
+{
+  const ptrdiff_t h = 71;
+  const ptrdiff_t w = 200;
+  Image2d<unsigned char> src(h, w);
+  std::mt19937 gen(7);
+  std::bernoulli_distribution dist(0.7);
+  foreach2d(src, y, x)
+    src(y, x) = dist(gen) ? 1 : 0;
+
+  BinaryImage mask;
+  to_binary(src, mask);
+
+  detail::ScopedMaxThreads threads(4);
+  for (const auto& [ry, rx] : { std::pair<ptrdiff_t, ptrdiff_t>(0, 0), { 1, 1 }, { 2, 5 }, { 3, 70 }, { 0, 130 } })
+  {
+    Image2d<unsigned char> expected_eroded(h, w);
+    Image2d<unsigned char> expected_dilated(h, w);
+    erode(src, ry, rx, BorderCondition::BC_CLAMP, expected_eroded);
+    dilate(src, ry, rx, BorderCondition::BC_CLAMP, expected_dilated);
+
+    BinaryImage eroded;
+    BinaryImage dilated;
+    erode(mask, ry, rx, eroded);
+    dilate(mask, ry, rx, dilated);
+
+    Image2d<unsigned char> unpacked_eroded;
+    Image2d<unsigned char> unpacked_dilated;
+    from_binary(eroded, 1, 0, unpacked_eroded);
+    from_binary(dilated, 1, 0, unpacked_dilated);
+    ASSERT_TRUE(detail::are_identical(unpacked_eroded, expected_eroded)) << ry << " " << rx;
+    ASSERT_TRUE(detail::are_identical(unpacked_dilated, expected_dilated)) << ry << " " << rx;
+  }
 }
 
 TEST(CannyEdgeDetectionTest, AngleBinTest)
@@ -238,3 +1090,465 @@ TEST(Image2dBasicTest, ExportArray)
   export_image("test_sobel_y.ppm", grad_y);
   export_image("test_canny.ppm", canny);
 }
+
+TEST(OperationChainTest, ViewExecutionMatchesImageExecution)
+{
+  const ptrdiff_t h = 100;
+  const ptrdiff_t w = 120;
+  Image2d<float> src(h, w);
+  detail::draw_circle(h / 2, w / 2, 30, src);
+
+  OperationChain chain;
+  chain.addOperation(0, FilterConfig{ 2, 2, 1.f, 1.f });
+  chain.addOperation(1, GradConfig{ GradConfig::GradType::GradAbs });
+  chain.addOperation(2, ThresholdConfig{ 0.1f, 1.f, 0.f });
+
+  Image2d<float> expected;
+  chain.executeChain(src, expected);
+  ASSERT_EQ(expected.height(), h);
+  ASSERT_EQ(expected.width(), w);
+
+  Image2d<float> result(h + 2, w + 2);
+  chain.executeChain(src.view(), result.view().roi(1, 1, h, w));
+
+  foreach2d(expected, y, x)
+    ASSERT_EQ(expected(y, x), result(y + 1, x + 1));
+}
+
+TEST(OperationChainTest, RepeatedExecutionReusesScratchImages)
+{
+  const ptrdiff_t h = 64;
+  const ptrdiff_t w = 80;
+  Image2d<float> src(h, w);
+  detail::draw_circle(h / 2, w / 2, 20, src);
+
+  OperationChain chain;
+  chain.addOperation(0, FilterConfig{ 2, 2, 1.f, 1.f });
+  chain.addOperation(1, GradConfig{ GradConfig::GradType::GradAbs });
+  chain.addOperation(2, CannyConfig{ 0.1f, 0.3f });
+
+  Image2d<float> first, second;
+  chain.executeChain(src, first);
+
+  ImagePool::global().resetStats();
+  chain.executeChain(src, second);
+
+  // All scratch images of the second run come from the pool.
+  const auto stats = ImagePool::global().stats();
+  ASSERT_EQ(stats.allocations, 0);
+  ASSERT_GT(stats.reuses, 0);
+  ASSERT_GE(stats.bytes_reused, stats.reuses * sizeof(float));
+
+  ASSERT_TRUE(detail::are_identical(first, second));
+}
+
+TEST(OperationChainTest, FusedExecutionMatchesStaged)
+{
+  const ptrdiff_t h = 150;
+  const ptrdiff_t w = 90;
+  Image2d<float> src(h, w);
+  detail::draw_circle(h / 2, w / 2, 40, src);
+
+  OperationChain chain;
+  chain.addOperation(0, FilterConfig{ 3, 4, 1.5f, 2.f });
+  chain.addOperation(1, GradConfig{ GradConfig::GradType::GradAbs });
+  chain.addOperation(2, ThresholdConfig{ 0.2f, 1.f, 0.f });
+  chain.addOperation(3, CannyConfig{ 0.1f, 0.3f });
+  chain.addOperation(4, FilterConfig{ 2, 2, 1.f, 1.f });
+  chain.addOperation(5, GradConfig{ GradConfig::GradType::GradY });
+
+  Image2d<float> staged;
+  chain.executeChain(src, staged);
+
+  // Strips are distributed over the threads, which must not change the result either.
+  detail::ScopedMaxThreads threads(4);
+  chain.setExecutionMode(ExecutionMode::Fused);
+  for (ptrdiff_t strip_rows : { 0, 1, 7, 32, 200 })
+  {
+    chain.setStripRows(strip_rows);
+
+    Image2d<float> fused;
+    chain.executeChain(src, fused);
+    ASSERT_TRUE(detail::are_identical(staged, fused));
+  }
+}
+
+TEST(OperationChainTest, MorphOperationsFuseLikeStaged)
+{
+  const ptrdiff_t h = 180;
+  const ptrdiff_t w = 150;
+  Image2d<float> src(h, w);
+  detail::fill_random(src, 43);
+
+  OperationChain staged;
+  OperationChain fused;
+  fused.setExecutionMode(ExecutionMode::Fused);
+  fused.setStripRows(16);
+
+  int id = 0;
+  for (const auto type : { MorphConfig::MorphType::Erode, MorphConfig::MorphType::Dilate,
+    MorphConfig::MorphType::Open, MorphConfig::MorphType::Close })
+  {
+    staged.addOperation(id, MorphConfig{ type, 3, 2 });
+    fused.addOperation(id, MorphConfig{ type, 3, 2 });
+    ++id;
+  }
+
+  Image2d<float> expected(h, w);
+  Image2d<float> result(h, w);
+  staged.executeChain(src, expected);
+  fused.executeChain(src, result);
+  ASSERT_TRUE(detail::are_identical(expected, result));
+
+  // The first stage alone is the plain erosion (the config holds the x radius first).
+  OperationChain erosion;
+  erosion.addOperation(0, MorphConfig{ MorphConfig::MorphType::Erode, 3, 2 });
+  erosion.executeChain(src, result);
+  erode(src, 2, 3, BorderCondition::BC_CLAMP, expected);
+  ASSERT_TRUE(detail::are_identical(expected, result));
+}
+
+TEST(OperationChainTest, TypedStagesMatchFloatStages)
+{
+  const ptrdiff_t h = 120;
+  const ptrdiff_t w = 100;
+  Image2d<float> src(h, w);
+  detail::fill_random(src, 44);
+
+  // The threshold writes U8, so the dilation runs on U8 and the filter converts back.
+  OperationChain chain;
+  chain.addOperation(0, FilterConfig{ 2, 2, 1.f, 1.f });
+  chain.addOperation(1, ThresholdConfig{ 128.f, 255.f, 0.f });
+  chain.addOperation(2, MorphConfig{ MorphConfig::MorphType::Dilate, 2, 1 });
+  ASSERT_EQ(chain.outputType(PixelType::F32), PixelType::U8);
+
+  Image2d<float> expected;
+  chain.executeChain(src, expected);
+
+  for (const auto mode : { ExecutionMode::Staged, ExecutionMode::Fused })
+  {
+    chain.setExecutionMode(mode);
+
+    AnyImage result;
+    chain.executeChain(src.view(), result);
+    ASSERT_EQ(pixel_type(result), PixelType::U8);
+
+    Image2d<float> result_float(h, w);
+    fill(result_float, std::get<Image2d<unsigned char>>(result));
+    ASSERT_TRUE(detail::are_identical(expected, result_float));
+  }
+
+  chain.addOperation(3, FilterConfig{ 1, 1, 1.f, 1.f });
+  ASSERT_EQ(chain.outputType(PixelType::U8), PixelType::F32);
+
+  // U8 images pass through the morphology without a conversion.
+  Image2d<unsigned char> src_u8(h, w);
+  convert_image(src.view(), src_u8.view());
+
+  OperationChain morph;
+  morph.addOperation(0, MorphConfig{ MorphConfig::MorphType::Close, 3, 2 });
+  AnyImage closed;
+  morph.executeChain(src_u8.view(), closed);
+
+  Image2d<unsigned char> expected_u8(h, w);
+  morph_close(src_u8, 2, 3, BorderCondition::BC_CLAMP, expected_u8);
+  ASSERT_TRUE(detail::are_identical(expected_u8, std::get<Image2d<unsigned char>>(closed)));
+}
+
+TEST(OperationChainTest, ProfilingRecordsEveryOperation)
+{
+  const ptrdiff_t h = 90;
+  const ptrdiff_t w = 80;
+  Image2d<float> src(h, w);
+  detail::fill_random(src, 45);
+
+  OperationChain chain;
+  chain.setExecutionMode(ExecutionMode::Fused);
+  chain.addOperation(4, FilterConfig{ 2, 2, 1.f, 1.f });
+  chain.addOperation(7, GradConfig{ GradConfig::GradType::GradAbs });
+  chain.addOperation(9, CannyConfig{ 10.f, 30.f });
+
+  Image2d<float> expected;
+  chain.executeChain(src, expected);
+  ASSERT_TRUE(chain.profile().empty());
+
+  // The scratch images of the first profiled execution are allocated anew.
+  ImagePool::global().clear();
+  chain.setProfiling(true);
+
+  Image2d<float> result(h, w);
+  chain.executeChain(src, result);
+  ASSERT_TRUE(detail::are_identical(expected, result));
+
+  auto profile = chain.profile();
+  ASSERT_EQ(profile.size(), 3u);
+  size_t bytes_allocated = 0;
+  for (size_t i = 0; i < profile.size(); ++i)
+  {
+    ASSERT_EQ(profile[i].id, (std::vector<int>{ 4, 7, 9 })[i]);
+    ASSERT_FALSE(profile[i].cached);
+    ASSERT_GE(profile[i].seconds, 0.0);
+    bytes_allocated += profile[i].bytes_allocated;
+  }
+  ASSERT_GT(bytes_allocated, 0u);
+
+  // Only the modified stage and the following ones are recomputed.
+  chain.setCaching(true);
+  chain.executeChain(src, result);
+  chain.modifyOperation(7, GradConfig{ GradConfig::GradType::GradX });
+  chain.executeChain(src, result);
+
+  profile = chain.profile();
+  ASSERT_EQ(profile.size(), 3u);
+  ASSERT_TRUE(profile[0].cached);
+  ASSERT_FALSE(profile[1].cached);
+  ASSERT_FALSE(profile[2].cached);
+
+  chain.setProfiling(false);
+  ASSERT_TRUE(chain.profile().empty());
+}
+
+TEST(OperationChainTest, BatchMatchesSingleExecutions)
+{
+  set_max_threads(4);
+
+  // Patches of two sizes, so that the workers resize their scratch images.
+  std::vector<Image2d<float>> patches;
+  for (unsigned i = 0; i < 23; ++i)
+  {
+    patches.emplace_back(i % 3 == 0 ? 40 : 32, i % 3 == 0 ? 24 : 32);
+    detail::fill_random(patches.back(), 100 + i);
+  }
+
+  for (const auto mode : { ExecutionMode::Staged, ExecutionMode::Fused })
+  {
+    OperationChain chain;
+    chain.setExecutionMode(mode);
+    chain.addOperation(0, FilterConfig{ 2, 2, 1.f, 1.f });
+    chain.addOperation(1, ThresholdConfig{ 128.f, 255.f, 0.f });
+    chain.addOperation(2, MorphConfig{ MorphConfig::MorphType::Open, 1, 1 });
+    chain.addOperation(3, GradConfig{ GradConfig::GradType::GradAbs });
+
+    std::vector<Image2d<float>> results;
+    chain.executeBatch(patches, results);
+    ASSERT_EQ(results.size(), patches.size());
+
+    for (size_t i = 0; i < patches.size(); ++i)
+    {
+      Image2d<float> expected;
+      chain.executeChain(patches[i], expected);
+      ASSERT_TRUE(detail::are_identical(expected, results[i]));
+    }
+  }
+
+  set_max_threads(0);
+}
+
+TEST(OperationChainTest, CancelledExecutionStopsBetweenStages)
+{
+  Image2d<float> src(60, 50);
+  detail::fill_random(src, 7);
+
+  for (const bool caching : { false, true })
+  {
+    OperationChain chain;
+    chain.setCaching(caching);
+    chain.addOperation(0, FilterConfig{ 2, 2, 1.f, 1.f });
+    chain.addOperation(1, GradConfig{ GradConfig::GradType::GradAbs });
+    chain.addOperation(2, ThresholdConfig{ 20.f, 255.f, 0.f });
+
+    // Cancel once the first stage is done.
+    ExecutionControl cancelled;
+    std::vector<size_t> progress;
+    cancelled.setProgressCallback([&](size_t done, size_t total)
+      {
+        ASSERT_EQ(total, 3u);
+        progress.push_back(done);
+        if (done == 1)
+          cancelled.cancel();
+      });
+
+    Image2d<float> dst;
+    ASSERT_FALSE(chain.executeChain(src, dst, cancelled));
+    ASSERT_EQ(progress.back(), 1u);
+
+    // A later execution runs to the end, resuming from the first stage when caching.
+    ExecutionControl control;
+    progress.clear();
+    control.setProgressCallback([&](size_t done, size_t) { progress.push_back(done); });
+    ASSERT_TRUE(chain.executeChain(src, dst, control));
+    ASSERT_EQ(progress, (std::vector<size_t>{ 1, 2, 3 }));
+
+    OperationChain reference;
+    reference.addOperation(0, FilterConfig{ 2, 2, 1.f, 1.f });
+    reference.addOperation(1, GradConfig{ GradConfig::GradType::GradAbs });
+    reference.addOperation(2, ThresholdConfig{ 20.f, 255.f, 0.f });
+
+    Image2d<float> expected;
+    reference.executeChain(src, expected);
+    ASSERT_TRUE(detail::are_identical(expected, dst));
+  }
+}
+
+TEST(OperationChainTest, CancellationInterruptsOperations)
+{
+  for (const size_t n_threads : { 1, 4 })
+  {
+    set_max_threads(n_threads);
+
+    // The loop stops at the chunk boundary after the flag is set.
+    std::atomic<bool> flag{ false };
+    std::atomic<ptrdiff_t> processed{ 0 };
+    {
+      CancellationScope scope(flag);
+      parallel_for(0, 1000, 10, [&](ptrdiff_t begin, ptrdiff_t end)
+        {
+          processed += end - begin;
+          flag = true;
+        });
+    }
+    ASSERT_LT(processed.load(), 1000);
+
+    // Without a scope, the flag is not looked at.
+    processed = 0;
+    parallel_for(0, 1000, 10, [&](ptrdiff_t begin, ptrdiff_t end) { processed += end - begin; });
+    ASSERT_EQ(processed.load(), 1000);
+  }
+
+  set_max_threads(0);
+
+  // An execution cancelled within its only stage fails, and the stage is not cached.
+  Image2d<float> src(300, 200);
+  detail::fill_random(src, 3);
+
+  OperationChain chain;
+  chain.setCaching(true);
+  chain.addOperation(0, FilterConfig{ 3, 3, 2.f, 2.f });
+
+  ExecutionControl control;
+  control.cancel();
+  Image2d<float> dst;
+  ASSERT_FALSE(chain.executeChain(src, dst, control));
+
+  Image2d<float> expected;
+  chain.executeChain(src, dst);
+  OperationChain reference;
+  reference.addOperation(0, FilterConfig{ 3, 3, 2.f, 2.f });
+  reference.executeChain(src, expected);
+  ASSERT_TRUE(detail::are_identical(expected, dst));
+}
+
+TEST(OperationChainTest, CachedExecutionFollowsChainChanges)
+{
+  const ptrdiff_t h = 80;
+  const ptrdiff_t w = 70;
+  Image2d<float> src(h, w);
+  detail::draw_circle(h / 2, w / 2, 25, src);
+
+  OperationChain cached, reference;
+  cached.setCaching(true);
+
+  const auto add = [&](int op_id, OpConfig const& config)
+  {
+    cached.addOperation(op_id, config);
+    reference.addOperation(op_id, config);
+  };
+
+  const auto expect_same_result = [&]()
+  {
+    Image2d<float> cached_res, reference_res;
+    cached.executeChain(src, cached_res);
+    reference.executeChain(src, reference_res);
+    ASSERT_TRUE(detail::are_identical(cached_res, reference_res));
+  };
+
+  add(0, FilterConfig{ 2, 2, 1.f, 1.f });
+  add(1, GradConfig{ GradConfig::GradType::GradAbs });
+  add(2, ThresholdConfig{ 0.2f, 1.f, 0.f });
+  expect_same_result();
+
+  cached.modifyOperation(2, ThresholdConfig{ 0.4f, 1.f, 0.f });
+  reference.modifyOperation(2, ThresholdConfig{ 0.4f, 1.f, 0.f });
+  expect_same_result();
+
+  cached.modifyOperation(0, FilterConfig{ 3, 1, 2.f, 0.5f });
+  reference.modifyOperation(0, FilterConfig{ 3, 1, 2.f, 0.5f });
+  expect_same_result();
+
+  add(3, FilterConfig{ 1, 1, 1.f, 1.f });
+  expect_same_result();
+
+  cached.removeOperation(1);
+  reference.removeOperation(1);
+  expect_same_result();
+
+  // Changing the input in place requires an explicit invalidation.
+  detail::draw_circle(h / 3, w / 3, 10, src);
+  cached.invalidateCache();
+  expect_same_result();
+}
+
+TEST(SerializationTest, ChainDescriptionRoundTrips)
+{
+  FilterConfig iir_filter{ 0, 0, 2.5f, 1.25f };
+  iir_filter.method = FilterConfig::Method::IIR;
+
+  const std::vector<OpConfig> chain = {
+    FilterConfig{ 3, 2, 1.5f, 0.7f },
+    iir_filter,
+    GradConfig{ GradConfig::GradType::GradAbs },
+    ThresholdConfig{ 0.1f, 255.f, 0.f },
+    CannyConfig{ 10.f, 30.f },
+    MorphConfig{ MorphConfig::MorphType::Close, 1, 4 } };
+
+  std::stringstream stream;
+  stream << "# comment\n\n";
+  write_chain(stream, chain);
+
+  const auto parsed = read_chain(stream);
+  ASSERT_TRUE(parsed == chain);
+
+  for (const auto line : { "blur radius=1", "gradient", "gradient type=z", "canny lo=1 hi=x",
+    "morph type=open radius_x=1 radius_y=-1", "canny lo=1 hi=2 extra=3" })
+  {
+    std::istringstream bad_stream(line);
+    ASSERT_THROW(read_chain(bad_stream), std::runtime_error);
+  }
+}
+
+TEST(ImageIOTest, PgmFilesRoundTrip)
+{
+  const ptrdiff_t h = 31;
+  const ptrdiff_t w = 45;
+  Image2d<unsigned char> img(h, w);
+  Image2d<uint16_t> wide_img(h, w);
+  foreach2d(img, y, x)
+  {
+    img(y, x) = static_cast<unsigned char>((7 * y + 3 * x) % 256);
+    wide_img(y, x) = static_cast<uint16_t>(1000 * y + x);
+  }
+
+  Image2d<float> read;
+  Image2d<float> expected(h, w);
+  write_pgm("test_io.pgm", img.view());
+  read_pnm("test_io.pgm", read);
+  fill(expected, img);
+  ASSERT_TRUE(detail::are_identical(expected, read));
+
+  write_pgm("test_io_wide.pgm", wide_img.view());
+  read_pnm("test_io_wide.pgm", read);
+  fill(expected, wide_img);
+  ASSERT_TRUE(detail::are_identical(expected, read));
+
+  ASSERT_THROW(read_pnm("test_io_missing.pgm", read), std::runtime_error);
+
+  // Headers whose size overflows or does not fit the file fail before allocating.
+  for (const auto header : { "P5 4294967296 4294967296 255\n", "P6 65536 65536 65535\n", "P2 50000 50000 255\n" })
+  {
+    {
+      std::ofstream file("test_io_bad.pgm", std::ios::binary);
+      file << header << "0 1 2 3";
+    }
+    ASSERT_THROW(read_pnm("test_io_bad.pgm", read), std::runtime_error) << header;
+  }
+}
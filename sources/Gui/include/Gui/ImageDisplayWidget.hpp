@@ -4,12 +4,12 @@
 #include <QWidget>
 #include <QGraphicsView>
 
-class ImageView : public QGraphicsView
+class ImageGraphicsView : public QGraphicsView
 {
   Q_OBJECT
 
 public:
-  ImageView(QWidget* parent = nullptr);
+  ImageGraphicsView(QWidget* parent = nullptr);
 
   void setImage(QPixmap img);
 
@@ -35,7 +35,7 @@ signals:
   void imageHovered(QPointF const& pt);
 
 private:
-  ImageView* image_view_ = nullptr;
+  ImageGraphicsView* image_view_ = nullptr;
 
   QLabel* label_x_ = nullptr;
   QLabel* label_y_ = nullptr;
@@ -4,24 +4,81 @@
 
 #include <Core/Core.hpp>
 
+#include <QObject>
+#include <QTimer>
+
+#include <memory>
+#include <thread>
+
 namespace detail
 {
   void create_image2d_from_qimage(QImage const& qimg, Image2d<float>& img);
   QImage create_qimage_from_image2d(Image2d<float> const& img);
+
+  // Smallest downscaling factor that brings the image to at most max_pixels pixels.
+  ptrdiff_t proxy_factor(Position const& sz, ptrdiff_t max_pixels);
 }
 
-class MainControl
+Q_DECLARE_METATYPE(std::shared_ptr<Image2d<float>>)
+
+// Executes the chain on a background thread, one job at a time. Changes to the chain
+// cancel the running job first, so that the worker always has the chains to itself.
+// In the live preview mode, changes re-execute the chain once they stop coming for a 
+// moment, first on a downscaled proxy of the image, then at full resolution.
+class MainControl : public QObject
 {
+  Q_OBJECT
+
 public:
   explicit MainControl(MainWidget* main_widget);
+  ~MainControl();
+
+signals:
+  // Emitted from the worker thread, hence delivered through queued connections.
+  void executionProgress(int job, int done, int total);
+
+  // The factor is the downscaling of a proxy result, 1 for the full resolution result.
+  void executionFinished(int job, std::shared_ptr<Image2d<float>> result, int factor);
 
 private:
-  void setDisplayedImage(MainWidget* widget, Image2d<float> const& img);
+  // The factor is the downscaling of img relative to current_img_.
+  void setDisplayedImage(MainWidget* widget, Image2d<float> const& img, ptrdiff_t factor = 1);
+
+  void startExecution(bool with_proxy);
+
+  // Restarts the countdown to the live preview execution, if enabled.
+  void schedulePreview();
+
+  // Cancels the running job, if any, and resets the progress. Results the job has 
+  // already sent are dropped.
+  void cancelExecution();
+
+  // Same as above without touching the widget, returns whether a job was running.
+  bool stopWorker();
+
+  MainWidget* main_widget_ = nullptr;
 
   Image2d<float> current_img_;
   Image2d<float> result_img_;
 
+  // Downscaled current image and the chain result on it.
+  ptrdiff_t proxy_factor_ = 1;
+  Image2d<float> proxy_img_;
+  Image2d<float> proxy_result_img_;
+
   Image2d<float> const* displayed_img_ = nullptr;
+  ptrdiff_t displayed_factor_ = 1;
 
   OperationChain op_chain_;
-};
\ No newline at end of file
+
+  // Same operations as op_chain_, with their own cache for the proxy image.
+  OperationChain proxy_chain_;
+
+  bool live_preview_ = false;
+  QTimer preview_timer_;
+
+  // The last started job, the results of the previous ones are dropped.
+  int job_ = 0;
+  std::shared_ptr<ExecutionControl> job_control_;
+  std::thread worker_;
+};
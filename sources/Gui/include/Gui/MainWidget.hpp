@@ -1,11 +1,14 @@
 #pragma once
 
 #include <Gui/ImageDisplayWidget.hpp>
+#include <Gui/OpListWidget.hpp>
 
+#include <Core/Core.hpp>
 #include <Core/OpConfigDefines.hpp>
 
 #include <QWidget>
 #include <QGraphicsView>
+#include <QProgressBar>
 #include <QVBoxLayout>
 
 class MainWidget : public QWidget
@@ -19,6 +22,12 @@ public:
 
   void setHoveredPixelValue(int x, int y, float val);
 
+  // Shows the profile of the last execution in the operation list.
+  void setOpProfile(std::vector<OpProfile> const& profile);
+
+  // Shows how many operations of the running execution are done.
+  void setExecutionProgress(int done, int total);
+
 signals:
   void loadClicked();
 
@@ -29,11 +38,15 @@ signals:
   void opRemoved(int op_id);
 
   void executeClicked();
+  void profilingToggled(bool enabled);
+  void livePreviewToggled(bool enabled);
 
 private:
   void onOperationSelected(QString const& new_op);
 
   ImageDisplayWidget* image_display_widget_ = nullptr;
+  OpListWidget* op_list_widget_ = nullptr;
+  QProgressBar* progress_bar_ = nullptr;
   QVBoxLayout* op_config_layout_ = nullptr;
 
   // Currently active operation and corresponding configuration.
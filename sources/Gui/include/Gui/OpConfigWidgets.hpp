@@ -51,9 +51,9 @@ namespace detail
     bool ok = false;
 
     T val;
-    if constexpr (std::is_same_v<T, GradConfig::GradType>)
+    if constexpr (std::is_enum_v<T>)
     {
-      val = static_cast<GradConfig::GradType>(var.toInt(&ok));
+      val = static_cast<T>(var.toInt(&ok));
     }
 
     if (ok)
@@ -65,7 +65,7 @@ namespace detail
   template<typename T>
   QVariant getVariantHelper(T const& val)
   {
-    if constexpr (std::is_same_v<T, GradConfig::GradType>)
+    if constexpr (std::is_enum_v<T>)
     {
       return QVariant(static_cast<int>(val));
     }
@@ -241,3 +241,17 @@ private:
 
   CannyConfig config_;
 };
+
+class MorphConfigWidget : public OpConfigWidget
+{
+  Q_OBJECT
+
+public:
+  MorphConfigWidget(QWidget* parent = nullptr);
+  MorphConfigWidget(MorphConfig const& config, QWidget* parent = nullptr);
+
+private:
+  void initWidget(bool init_entries);
+
+  MorphConfig config_;
+};
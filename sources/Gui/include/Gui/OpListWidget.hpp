@@ -1,10 +1,15 @@
 #pragma once
 
+#include <Core/Core.hpp>
 #include <Core/OpConfigDefines.hpp>
 
+#include <QLabel>
 #include <QWidget>
 #include <QLayout>
 
+#include <unordered_map>
+#include <vector>
+
 class OpListItem : public QWidget
 {
   Q_OBJECT
@@ -12,9 +17,16 @@ class OpListItem : public QWidget
 public:
   OpListItem(OpConfig const& config, QWidget* parent = nullptr);
 
+  // Shows the measurements of the last profiled execution.
+  void setProfile(OpProfile const& profile);
+  void clearProfile();
+
 signals:
   void configChanged(OpConfig const& config);
   void removeClicked();
+
+private:
+  QLabel* profile_label_ = nullptr;
 };
 
 class OpListWidget : public QWidget
@@ -27,12 +39,16 @@ public:
   // Adds operation to the list and returns its unique ID.
   int addOperation(OpConfig const& config);
 
+  // Shows every profile next to the operation of its ID, an empty list clears them.
+  void setProfile(std::vector<OpProfile> const& profile);
+
 signals:
   void configChanged(int op_id, OpConfig const& config);
   void opRemoved(int op_id);
 
 private:
   QLayout* op_list_layout_ = nullptr;
+  std::unordered_map<int, OpListItem*> op_items_;
 
   int current_op_id_ = 0;
 };
\ No newline at end of file
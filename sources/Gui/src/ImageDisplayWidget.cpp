@@ -3,20 +3,20 @@
 #include <QMouseEvent>
 #include <QLayout>
 
-ImageView::ImageView(QWidget* parent) : QGraphicsView(parent)
+ImageGraphicsView::ImageGraphicsView(QWidget* parent) : QGraphicsView(parent)
 {
   this->setMouseTracking(true);
   this->setScene(new QGraphicsScene(this));
 }
 
-void ImageView::setImage(QPixmap img)
+void ImageGraphicsView::setImage(QPixmap img)
 {
   this->scene()->clear();
   this->scene()->addPixmap(img);
   this->fitInView(this->sceneRect(), Qt::KeepAspectRatio);
 }
 
-void ImageView::mouseMoveEvent(QMouseEvent* event)
+void ImageGraphicsView::mouseMoveEvent(QMouseEvent* event)
 {
   const auto image_pos = this->mapToScene(event->pos());
   emit imageHovered(image_pos);
@@ -29,7 +29,7 @@ ImageDisplayWidget::ImageDisplayWidget(QWidget* parent)
   label_y_ = new QLabel("y: 0");
   label_val_ = new QLabel("value: 0");
 
-  image_view_ = new ImageView();
+  image_view_ = new ImageGraphicsView();
 
   // Setup layout.
   auto main_layout = new QVBoxLayout();
@@ -45,7 +45,7 @@ ImageDisplayWidget::ImageDisplayWidget(QWidget* parent)
   stats_layout->addStretch();
 
   // Make connections.
-  QObject::connect(image_view_, &ImageView::imageHovered,
+  QObject::connect(image_view_, &ImageGraphicsView::imageHovered,
     [this](QPointF const& img_pos)
     {
       emit this->imageHovered(img_pos);
@@ -3,53 +3,78 @@
 #include <QFileDialog>
 
 #include <iostream>
+#include <utility>
 
 namespace detail
 {
   void create_image2d_from_qimage(QImage const& qimg, Image2d<float>& img)
   {
-    img.alloc(qimg.height(), qimg.width());
+    img.allocUninitialized(qimg.height(), qimg.width());
 
-    foreach_y(img, y)
+    // The scan lines are viewed in place, their stride is bytesPerLine(). Gray images
+    // are converted directly, any other format through (A)RGB32.
+    if (qimg.format() == QImage::Format_Grayscale8)
     {
-      // QImage has a method pixel() to access each individual pixel value, 
-      // but the documentation suggests the scanLine() method in case where 
-      // we want to access all the pixels for performance reasons.
-      const auto row = reinterpret_cast<QRgb const*>(qimg.constScanLine(y));
-      foreach_x(img, x)
-      {
-        const auto& rgb = row[x];
-        img(y, x) = 0.333333f * float(qRed(rgb) + qGreen(rgb) + qBlue(rgb));
-      }
+      const ConstImageView<unsigned char> gray(qimg.constBits(), qimg.height(), qimg.width(), qimg.bytesPerLine());
+      convert_image(gray, img.view());
+      return;
     }
+
+    const auto is_rgb32 = qimg.format() == QImage::Format_RGB32 || qimg.format() == QImage::Format_ARGB32;
+    const auto rgb_img = is_rgb32 ? qimg : qimg.convertToFormat(QImage::Format_RGB32);
+    const ConstImageView<uint32_t> rgb(reinterpret_cast<uint32_t const*>(rgb_img.constBits()),
+      rgb_img.height(), rgb_img.width(), rgb_img.bytesPerLine() / ptrdiff_t(sizeof(uint32_t)));
+
+    rgb32_to_gray(rgb, img.view());
   }
 
   QImage create_qimage_from_image2d(Image2d<float> const& img)
   {
-    QImage qimg(img.width(), img.height(), QImage::Format_RGB32);
+    // 8 bit gray needs a quarter of the memory of RGB32 and is displayed the same.
+    QImage qimg(img.width(), img.height(), QImage::Format_Grayscale8);
+    if (img.height() == 0 || img.width() == 0)
+      return qimg;
 
-    const auto max_val = max_value(img);
-    const auto min_val = min_value(img);
-    const auto scale = 254.f / (max_val - min_val);
-    foreach_y(img, y)
-    {
-      // QImage has a method pixel() to access each individual pixel value, 
-      // but the documentation suggests the scanLine() method in case where 
-      // we want to access all the pixels for performance reasons.
-      const auto row = reinterpret_cast<QRgb*>(qimg.scanLine(y));
-      foreach_x(img, x)
-      {
-        const auto val = int(scale * (img(y, x) - min_val));
-        row[x] = qRgb(val, val, val);
-      }
-    }
+    const auto [min_val, max_val] = min_max_value(img);
+    const ImageView<unsigned char> gray(qimg.bits(), qimg.height(), qimg.width(), qimg.bytesPerLine());
+    to_display_gray(img.view(), min_val, max_val, gray);
 
     return qimg;
   }
+
+  ptrdiff_t proxy_factor(Position const& sz, ptrdiff_t max_pixels)
+  {
+    ptrdiff_t factor = 1;
+    while (downscaled_size(sz, factor).y * downscaled_size(sz, factor).x > max_pixels)
+      ++factor;
+
+    return factor;
+  }
+
+  // Proxy images have about one megapixel, so that a preview takes a fraction of a second.
+  constexpr ptrdiff_t proxy_max_pixels = 1 << 20;
+
+  // Pause in the changes after which the live preview executes.
+  constexpr int preview_delay_ms = 150;
 }
 
-MainControl::MainControl(MainWidget* main_widget)
+MainControl::MainControl(MainWidget* main_widget) : main_widget_(main_widget)
 {
+  qRegisterMetaType<std::shared_ptr<Image2d<float>>>();
+
+  // Keep the stage results, so that tweaking the tail of the chain only recomputes the tail.
+  op_chain_.setCaching(true);
+  proxy_chain_.setCaching(true);
+
+  // Coalesces bursts of changes, e.g. from dragging a slider, into a single execution.
+  preview_timer_.setSingleShot(true);
+  preview_timer_.setInterval(detail::preview_delay_ms);
+
+  QObject::connect(&preview_timer_, &QTimer::timeout, [this]()
+    {
+      this->startExecution(true);
+    });
+
   QObject::connect(main_widget, &MainWidget::loadClicked, [this, main_widget]()
     {
       const auto image_name = QFileDialog::getOpenFileName(
@@ -60,54 +85,212 @@ MainControl::MainControl(MainWidget* main_widget)
       QImage loaded_img;
       loaded_img.load(image_name);
 
+      this->cancelExecution();
       detail::create_image2d_from_qimage(loaded_img, current_img_);
+      op_chain_.invalidateCache();
+
+      proxy_factor_ = detail::proxy_factor(current_img_.size(), detail::proxy_max_pixels);
+      if (proxy_factor_ > 1)
+      {
+        downscale_box(current_img_, proxy_factor_, proxy_img_);
+        proxy_chain_.invalidateCache();
+      }
 
       this->setDisplayedImage(main_widget, current_img_);
+      this->schedulePreview();
     });
 
   QObject::connect(main_widget, &MainWidget::imageHovered, [this, main_widget](QPointF const& img_pos)
     {
       if (!displayed_img_) return;
 
+      // Proxy results are displayed at their own resolution.
       const auto pos = Position(img_pos.y(), img_pos.x());
       if (displayed_img_->isValid(pos))
       {
-        main_widget->setHoveredPixelValue(pos.x, pos.y, (*displayed_img_)(pos));
+        main_widget->setHoveredPixelValue(int(pos.x * displayed_factor_), int(pos.y * displayed_factor_), 
+          (*displayed_img_)(pos));
       }
     });
 
   QObject::connect(main_widget, &MainWidget::opAdded,
     [this](int op_id, OpConfig const& config)
     {
+      this->cancelExecution();
       this->op_chain_.addOperation(op_id, config);
+      this->proxy_chain_.addOperation(op_id, config);
+      this->schedulePreview();
     });
     
   QObject::connect(main_widget, &MainWidget::opChanged,
     [this](int op_id, OpConfig const& config)
     {
+      this->cancelExecution();
       this->op_chain_.modifyOperation(op_id, config);
+      this->proxy_chain_.modifyOperation(op_id, config);
+      this->schedulePreview();
     });
 
   QObject::connect(main_widget, &MainWidget::opRemoved,
     [this](int op_id)
     {
+      this->cancelExecution();
       this->op_chain_.removeOperation(op_id);
+      this->proxy_chain_.removeOperation(op_id);
+      this->schedulePreview();
     });
 
   QObject::connect(main_widget, &MainWidget::executeClicked, 
-    [this, main_widget]() 
+    [this]() 
+    {
+      this->preview_timer_.stop();
+      this->startExecution(false);
+    });
+
+  QObject::connect(main_widget, &MainWidget::profilingToggled,
+    [this, main_widget](bool enabled)
+    {
+      this->cancelExecution();
+      this->op_chain_.setProfiling(enabled);
+      main_widget->setOpProfile({});
+    });
+
+  QObject::connect(main_widget, &MainWidget::livePreviewToggled,
+    [this](bool enabled)
+    {
+      this->live_preview_ = enabled;
+      if (enabled)
+      {
+        this->schedulePreview();
+      }
+      else
+      {
+        this->preview_timer_.stop();
+      }
+    });
+
+  // The widget lives in the UI thread, so the worker signals are queued.
+  QObject::connect(this, &MainControl::executionProgress, main_widget,
+    [this, main_widget](int job, int done, int total)
     {
-      result_img_.alloc(current_img_.height(), current_img_.width());
-      this->op_chain_.executeChain(current_img_, result_img_);
+      if (job != job_) return;
 
+      main_widget->setExecutionProgress(done, total);
+    });
+
+  QObject::connect(this, &MainControl::executionFinished, main_widget,
+    [this, main_widget](int job, std::shared_ptr<Image2d<float>> result, int factor)
+    {
+      if (job != job_) return;
+
+      if (factor > 1)
+      {
+        // The full resolution result follows.
+        proxy_result_img_ = std::move(*result);
+        this->setDisplayedImage(main_widget, proxy_result_img_, factor);
+        return;
+      }
+
+      // The worker is done with the chains once the full result is sent.
+      if (worker_.joinable())
+        worker_.join();
+
+      job_control_.reset();
+
+      if (this->op_chain_.profiling())
+      {
+        main_widget->setOpProfile(this->op_chain_.profile());
+      }
+
+      result_img_ = std::move(*result);
       this->setDisplayedImage(main_widget, result_img_);
     });
 }
 
-void MainControl::setDisplayedImage(MainWidget* widget, Image2d<float> const& img)
+MainControl::~MainControl()
+{
+  // The widget may be gone already.
+  stopWorker();
+}
+
+void MainControl::setDisplayedImage(MainWidget* widget, Image2d<float> const& img, ptrdiff_t factor)
 {
   displayed_img_ = &img;
+  displayed_factor_ = factor;
 
   const auto qimg = detail::create_qimage_from_image2d(img);
   widget->setImage(qimg);
 }
+
+void MainControl::startExecution(bool with_proxy)
+{
+  cancelExecution();
+
+  if (current_img_.height() == 0 || current_img_.width() == 0) return;
+
+  const auto job = ++job_;
+  const auto proxy_factor = with_proxy ? proxy_factor_ : 1;
+  job_control_ = std::make_shared<ExecutionControl>();
+
+  worker_ = std::thread([this, job, proxy_factor, control = job_control_]()
+    {
+      // With a proxy, the progress bar covers both executions.
+      const int passes = proxy_factor > 1 ? 2 : 1;
+      const auto report_pass = [&](int pass)
+        {
+          control->setProgressCallback([this, job, pass, passes](size_t done, size_t total)
+            {
+              emit this->executionProgress(job, int(size_t(pass) * total + done), int(size_t(passes) * total));
+            });
+        };
+
+      if (proxy_factor > 1)
+      {
+        report_pass(0);
+        auto proxy_result = std::make_shared<Image2d<float>>(proxy_img_.size(), no_init);
+        if (!proxy_chain_.executeChain(proxy_img_, *proxy_result, *control))
+          return;
+
+        emit this->executionFinished(job, std::move(proxy_result), int(proxy_factor));
+      }
+
+      report_pass(passes - 1);
+      auto result = std::make_shared<Image2d<float>>(current_img_.size(), no_init);
+      if (op_chain_.executeChain(current_img_, *result, *control))
+      {
+        emit this->executionFinished(job, std::move(result), 1);
+      }
+    });
+}
+
+void MainControl::schedulePreview()
+{
+  if (live_preview_)
+    preview_timer_.start();
+}
+
+void MainControl::cancelExecution()
+{
+  if (!stopWorker())
+    return;
+
+  main_widget_->setExecutionProgress(0, 1);
+}
+
+bool MainControl::stopWorker()
+{
+  // Whatever the cancelled job already queued is dropped as stale.
+  ++job_;
+
+  const bool running = job_control_ != nullptr;
+  if (job_control_)
+  {
+    job_control_->cancel();
+    job_control_.reset();
+  }
+
+  if (worker_.joinable())
+    worker_.join();
+
+  return running;
+}
@@ -2,11 +2,13 @@
 #include <Gui/OpConfigWidgets.hpp>
 #include <Gui/OpListWidget.hpp>
 
+#include <QCheckBox>
 #include <QLabel>
 #include <QToolBar>
 #include <QPushButton>
 #include <QComboBox>
 
+#include <algorithm>
 #include <iostream>
 #include <vector>
 
@@ -42,8 +44,14 @@ MainWidget::MainWidget()
   auto select_op_combo = new QComboBox();
   auto add_op_button = new QPushButton("Add Operation");
   auto execute_button = new QPushButton("Execute Operation");
+  auto profile_check = new QCheckBox("Profile Operations");
+  auto live_preview_check = new QCheckBox("Live Preview");
 
-  const std::vector<QString> op_names = { "Threshold", "Filter", "Gradient", "Canny" };
+  progress_bar_ = new QProgressBar();
+  progress_bar_->setRange(0, 1);
+  progress_bar_->setValue(0);
+
+  const std::vector<QString> op_names = { "Threshold", "Filter", "Gradient", "Canny", "Morphology" };
   for (const auto& name : op_names)
   {
     select_op_combo->addItem(name);
@@ -51,7 +59,7 @@ MainWidget::MainWidget()
 
   op_config_layout_ = new QVBoxLayout();
 
-  auto op_list_widget = new OpListWidget();
+  op_list_widget_ = new OpListWidget();
 
   // Configure layout.
   auto full_layout = new QVBoxLayout();
@@ -70,8 +78,11 @@ MainWidget::MainWidget()
   ops_layout->addWidget(select_op_combo);
   ops_layout->addLayout(op_config_layout_);
   ops_layout->addWidget(add_op_button);
-  ops_layout->addWidget(op_list_widget);
+  ops_layout->addWidget(op_list_widget_);
   ops_layout->addWidget(execute_button);
+  ops_layout->addWidget(progress_bar_);
+  ops_layout->addWidget(profile_check);
+  ops_layout->addWidget(live_preview_check);
   ops_layout->addStretch();
 
   // Make connections.
@@ -96,20 +107,20 @@ MainWidget::MainWidget()
       this->onOperationSelected(new_op_name);
     });
 
-  QObject::connect(add_op_button, &QPushButton::clicked, [this, op_list_widget]() 
+  QObject::connect(add_op_button, &QPushButton::clicked, [this]() 
     {
-      const auto op_id = op_list_widget->addOperation(current_op_config_);
+      const auto op_id = op_list_widget_->addOperation(current_op_config_);
 
       emit opAdded(op_id, current_op_config_);
     });
 
-  QObject::connect(op_list_widget, &OpListWidget::configChanged,
+  QObject::connect(op_list_widget_, &OpListWidget::configChanged,
     [this](int op_id, OpConfig const& config)
     {
       emit opChanged(op_id, config);
     });
 
-  QObject::connect(op_list_widget, &OpListWidget::opRemoved,
+  QObject::connect(op_list_widget_, &OpListWidget::opRemoved,
     [this](int op_id)
     {
       emit opRemoved(op_id);
@@ -119,6 +130,16 @@ MainWidget::MainWidget()
     {
       emit this->executeClicked();
     });
+
+  QObject::connect(profile_check, &QCheckBox::toggled, [this](bool checked)
+    {
+      emit this->profilingToggled(checked);
+    });
+
+  QObject::connect(live_preview_check, &QCheckBox::toggled, [this](bool checked)
+    {
+      emit this->livePreviewToggled(checked);
+    });
 }
 
 void MainWidget::setImage(QImage img)
@@ -131,6 +152,17 @@ void MainWidget::setHoveredPixelValue(int x, int y, float val)
   image_display_widget_->setHoveredPixelValue(x, y, val);
 }
 
+void MainWidget::setOpProfile(std::vector<OpProfile> const& profile)
+{
+  op_list_widget_->setProfile(profile);
+}
+
+void MainWidget::setExecutionProgress(int done, int total)
+{
+  progress_bar_->setRange(0, std::max(total, 1));
+  progress_bar_->setValue(done);
+}
+
 void MainWidget::onOperationSelected(QString const& new_op)
 {
   OpConfigWidget* op_config_widget = nullptr;
@@ -150,6 +182,10 @@ void MainWidget::onOperationSelected(QString const& new_op)
   {
     op_config_widget = new CannyConfigWidget();
   }
+  else if (new_op == QString("Morphology"))
+  {
+    op_config_widget = new MorphConfigWidget();
+  }
   else
   {
     throw std::runtime_error(std::string("Selected operation not supported: ") + new_op.toStdString());
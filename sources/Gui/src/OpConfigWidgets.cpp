@@ -54,10 +54,17 @@ FilterConfigWidget::FilterConfigWidget(FilterConfig const& config, QWidget* pare
 
 void FilterConfigWidget::initWidget(bool init_entries)
 {
+  using MethodT = FilterConfig::Method;
+
+  const std::vector<std::pair<QString, MethodT>> name_method_pairs = {
+    {"Kernel (FIR)", MethodT::FIR},
+    {"Recursive (IIR)", MethodT::IIR} };
+
   auto radius_validator = new QIntValidator(1, 10, this);
-  auto sigma_validator = new QDoubleValidator(0.1, 10., 2, this);
+  auto sigma_validator = new QDoubleValidator(0.1, 100., 2, this);
 
   auto filter_form_widget = new FormWidget(init_entries);
+  filter_form_widget->addComboBox<MethodT>("Method:", name_method_pairs, &config_.method);
   filter_form_widget->addLineEdit<ptrdiff_t>("Kernel radius (x):", &config_.kernel_radius_x, radius_validator);
   filter_form_widget->addLineEdit<ptrdiff_t>("Kernel radius (y):", &config_.kernel_radius_y, radius_validator);
   filter_form_widget->addLineEdit<float>("Sigma (x):", &config_.sigma_x, sigma_validator);
@@ -135,3 +142,42 @@ void CannyConfigWidget::initWidget(bool init_entries)
       emit this->configurationChanged(config_);
     });
 }
+
+MorphConfigWidget::MorphConfigWidget(QWidget* parent) : OpConfigWidget(parent)
+{
+  initWidget(false);
+}
+
+MorphConfigWidget::MorphConfigWidget(MorphConfig const& config, QWidget* parent) : 
+  OpConfigWidget(parent), config_(config)
+{
+  initWidget(true);
+}
+
+void MorphConfigWidget::initWidget(bool init_entries)
+{
+  using MorphT = MorphConfig::MorphType;
+
+  const std::vector<std::pair<QString, MorphT>> name_type_pairs = {
+    {"Erode", MorphT::Erode},
+    {"Dilate", MorphT::Dilate},
+    {"Open", MorphT::Open},
+    {"Close", MorphT::Close} };
+
+  auto radius_validator = new QIntValidator(0, 100, this);
+
+  auto form_widget = new FormWidget(init_entries);
+  form_widget->addComboBox<MorphT>("Type:", name_type_pairs, &config_.type);
+  form_widget->addLineEdit<ptrdiff_t>("Kernel radius (x):", &config_.kernel_radius_x, radius_validator);
+  form_widget->addLineEdit<ptrdiff_t>("Kernel radius (y):", &config_.kernel_radius_y, radius_validator);
+
+  auto layout = new QVBoxLayout();
+  layout->addWidget(form_widget);
+
+  this->setLayout(layout);
+
+  QObject::connect(form_widget, &FormWidget::valueChanged, [this]() 
+    {
+      emit this->configurationChanged(config_);
+    });
+}
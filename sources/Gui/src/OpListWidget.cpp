@@ -28,6 +28,11 @@ namespace detail
     {
       return std::make_pair(QString("Canny"), new CannyConfigWidget(config));
     }
+
+    std::pair<QString, OpConfigWidget*> operator()(MorphConfig const& config)
+    {
+      return std::make_pair(QString("Morphology"), new MorphConfigWidget(config));
+    }
   };
 
   void remove_widget(QLayout* layout, QWidget* widget)
@@ -46,6 +51,8 @@ OpListItem::OpListItem(OpConfig const& config, QWidget* parent) : QWidget(parent
 
   auto op_label = new QLabel(name);
   auto remove_button = new QPushButton("R");
+  profile_label_ = new QLabel();
+  profile_label_->setVisible(false);
 
   auto main_layout = new QVBoxLayout();
   this->setLayout(main_layout);
@@ -53,6 +60,7 @@ OpListItem::OpListItem(OpConfig const& config, QWidget* parent) : QWidget(parent
   auto top_layout = new QHBoxLayout();
   main_layout->addLayout(top_layout);
   main_layout->addWidget(op_config_widget);
+  main_layout->addWidget(profile_label_);
 
   top_layout->addWidget(op_label);
   top_layout->addStretch();
@@ -71,6 +79,29 @@ OpListItem::OpListItem(OpConfig const& config, QWidget* parent) : QWidget(parent
     });
 }
 
+void OpListItem::setProfile(OpProfile const& profile)
+{
+  if (profile.cached)
+  {
+    profile_label_->setText("Cached result");
+  }
+  else
+  {
+    profile_label_->setText(QString("%1 ms, %2 MPix/s, %3 KiB allocated")
+      .arg(1e3 * profile.seconds, 0, 'f', 2)
+      .arg(1e-6 * profile.pixels_per_second, 0, 'f', 1)
+      .arg(double(profile.bytes_allocated) / 1024.0, 0, 'f', 0));
+  }
+
+  profile_label_->setVisible(true);
+}
+
+void OpListItem::clearProfile()
+{
+  profile_label_->clear();
+  profile_label_->setVisible(false);
+}
+
 OpListWidget::OpListWidget(QWidget* parent) : QWidget(parent)
 {
   auto op_list_label = new QLabel("Operation List:");
@@ -89,6 +120,7 @@ int OpListWidget::addOperation(OpConfig const& config)
   const auto op_id = current_op_id_++;
 
   op_list_layout_->addWidget(op_list_item);
+  op_items_[op_id] = op_list_item;
 
   QObject::connect(op_list_item, &OpListItem::configChanged,
     [this, op_id](OpConfig const& config) 
@@ -99,6 +131,7 @@ int OpListWidget::addOperation(OpConfig const& config)
   QObject::connect(op_list_item, &OpListItem::removeClicked,
     [this, op_list_item, op_id]() 
     {
+      op_items_.erase(op_id);
       detail::remove_widget(op_list_layout_, op_list_item);
 
       emit opRemoved(op_id);
@@ -106,3 +139,15 @@ int OpListWidget::addOperation(OpConfig const& config)
 
   return op_id;
 }
+
+void OpListWidget::setProfile(std::vector<OpProfile> const& profile)
+{
+  for (auto& [op_id, op_item] : op_items_)
+    op_item->clearProfile();
+
+  for (auto const& op_profile : profile)
+  {
+    if (auto it = op_items_.find(op_profile.id); it != op_items_.end())
+      it->second->setProfile(op_profile);
+  }
+}